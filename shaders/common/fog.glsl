@@ -0,0 +1,9 @@
+// exponential squared fog by eye distance, expects fPosEye from the includer
+
+float computeFog()
+{
+	float fogDensity = 0.015f;
+	float fragmentDistance = length(fPosEye.xyz);
+	float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
+	return clamp(fogFactor, 0.0f, 1.0f);
+}
@@ -0,0 +1,27 @@
+// Phong terms in eye space, expects fNormal, fPosEye, lightDir and lightColor from the includer
+
+vec3 ambient;
+float ambientStrength = 0.2f;
+vec3 diffuse;
+vec3 specular;
+float specularStrength = 0.5f;
+float shininess = 32.0f;
+
+void computeLightComponents()
+{
+	vec3 cameraPosEye = vec3(0.0f);
+
+	vec3 normalEye = normalize(fNormal);
+
+	vec3 lightDirN = normalize(lightDir);
+
+	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+
+	ambient = ambientStrength * lightColor;
+
+	diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+
+	vec3 reflection = reflect(-lightDirN, normalEye);
+	float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
+	specular = specularStrength * specCoeff * lightColor;
+}
@@ -0,0 +1,82 @@
+// cascaded shadow lookup, expects fPosEye and fPosWorld from the includer
+
+const int MAX_CASCADES = 4;
+
+uniform sampler2DArrayShadow shadowMap;        // static casters, cached between frames
+uniform sampler2DArrayShadow dynamicShadowMap; // moving casters, redrawn every frame
+uniform mat4 lightSpaceTrMatrices[MAX_CASCADES];
+uniform float cascadeSplits[MAX_CASCADES];  // view space far distance of each cascade
+uniform float cascadeBias[MAX_CASCADES];
+uniform int cascadeCount;
+
+// 0 = one hardware filtered tap, 1 = square grid, 2 = rotated Poisson disk
+uniform int pcfMode;
+uniform int pcfKernelSize;  // taps per side for the grid, total taps for the disk
+uniform float pcfRadius;    // kernel radius in texels
+
+const vec2 poissonDisk[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+	vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+	vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+	vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+	vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+// fraction of light reaching the point, each tap is a hardware filtered depth comparison
+float sampleLit(vec2 coords, float layer, float referenceDepth) {
+	vec4 shadowCoords = vec4(coords, layer, referenceDepth);
+	return texture(shadowMap, shadowCoords) * texture(dynamicShadowMap, shadowCoords);
+}
+
+float computeShadow() {
+	float viewDepth = -fPosEye.z;
+	int cascade = -1;
+	for (int i = 0; i < cascadeCount; i++) {
+		if (viewDepth < cascadeSplits[i]) {
+			cascade = i;
+			break;
+		}
+	}
+	if (cascade < 0) {
+		return 0.0f;
+	}
+
+	vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * fPosWorld;
+	vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	normalizedCoords = normalizedCoords * 0.5 + 0.5;
+	float referenceDepth = normalizedCoords.z - cascadeBias[cascade];
+	float layer = float(cascade);
+
+	if (pcfMode == 0) {
+		return 1.0f - sampleLit(normalizedCoords.xy, layer, referenceDepth);
+	}
+
+	vec2 texelSize = pcfRadius / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0f;
+	float taps = 0.0f;
+
+	if (pcfMode == 1) {
+		float halfKernel = float(pcfKernelSize - 1) * 0.5f;
+		for (int y = 0; y < pcfKernelSize; y++) {
+			for (int x = 0; x < pcfKernelSize; x++) {
+				vec2 offset = (vec2(x, y) - halfKernel) / max(halfKernel, 1.0f);
+				lit += sampleLit(normalizedCoords.xy + offset * texelSize, layer, referenceDepth);
+				taps += 1.0f;
+			}
+		}
+	} else {
+		// per-pixel rotation turns the banding of a fixed pattern into fine noise
+		float angle = 6.2831853f * fract(52.9829189f * fract(dot(gl_FragCoord.xy, vec2(0.06711056f, 0.00583715f))));
+		mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+		int diskTaps = clamp(pcfKernelSize, 1, 16);
+		for (int i = 0; i < diskTaps; i++) {
+			lit += sampleLit(normalizedCoords.xy + rotation * poissonDisk[i] * texelSize, layer, referenceDepth);
+			taps += 1.0f;
+		}
+	}
+
+	return 1.0f - lit / taps;
+}
@@ -0,0 +1,12 @@
+#version 410 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in float size;
+
+out vec3 vPosition;
+out float vSize;
+
+void main() {
+    vPosition = position;
+    vSize = size;
+}
@@ -0,0 +1,60 @@
+#version 410 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in float size;
+layout(location = 2) in vec3 velocity;
+layout(location = 3) in float lifetime;
+
+uniform float deltaTime;
+uniform vec3 windDirection;
+uniform float windStrength;
+uniform vec3 volumeCenter;
+uniform vec3 volumeHalfExtents;
+
+uniform bool hasHeightfield;
+uniform sampler2D heightfield;
+uniform vec2 heightfieldOrigin;
+uniform vec2 heightfieldSize;
+
+out vec3 outPosition;
+out float outSize;
+out vec3 outVelocity;
+out float outLifetime;
+
+void main() {
+    float windFactor = windStrength * 0.2;
+    float velocityDamping = 0.95;
+    bool isWindEnabled = windStrength > 0.0;
+
+    vec3 newVelocity = velocity;
+    if (isWindEnabled) {
+        newVelocity.x = newVelocity.x * velocityDamping + windDirection.x * windFactor;
+        newVelocity.z = newVelocity.z * velocityDamping + windDirection.z * windFactor;
+    } else {
+        newVelocity = vec3(0.0, -25.0, 0.0);
+    }
+
+    vec3 newPosition = position + newVelocity * deltaTime;
+
+    vec3 volumeMin = volumeCenter - volumeHalfExtents;
+    vec3 volumeSize = volumeHalfExtents * 2.0;
+
+    // drops hitting the terrain go back to the top of the volume
+    if (hasHeightfield) {
+        vec2 heightfieldCoords = (newPosition.xz - heightfieldOrigin) / heightfieldSize;
+        float groundHeight = textureLod(heightfield, heightfieldCoords, 0.0).r;
+        if (newPosition.y < groundHeight) {
+            newPosition.y = volumeMin.y + volumeSize.y - 0.001;
+        }
+    }
+
+    // wrap around the camera-relative volume instead of respawning
+    vec3 offset = newPosition - volumeMin;
+    offset -= volumeSize * floor(offset / volumeSize);
+    newPosition = volumeMin + offset;
+
+    outPosition = newPosition;
+    outSize = size;
+    outVelocity = newVelocity;
+    outLifetime = lifetime;
+}
@@ -4,10 +4,14 @@ in vec2 fTexCoords;
 
 out vec4 fColor;
 
-uniform sampler2D depthMap;
+uniform sampler2DArray depthMap;
+uniform sampler2DArray dynamicDepthMap;
+uniform int layer;
 
 void main() 
 {    
-    fColor = vec4(vec3(texture(depthMap, fTexCoords).r), 1.0f);
+    vec3 coords = vec3(fTexCoords, float(layer));
+    float depth = min(texture(depthMap, coords).r, texture(dynamicDepthMap, coords).r);
+    fColor = vec4(vec3(depth), 1.0f);
     //fColor = vec4(fTexCoords, 0.0f, 1.0f);
 }
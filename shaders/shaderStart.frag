@@ -3,79 +3,85 @@
 in vec3 fNormal;
 in vec4 fPosEye;
 in vec2 fTexCoords;
-in vec4 fragPosLightSpace;
+in vec4 fPosWorld;
 
 out vec4 fColor;
 
+// compiled per feature set by gps::ShaderVariants, which defines any of
+// SHADOWS, FOG, DIFFUSE_MAP, SPECULAR_MAP and SKYDOME
+
 uniform	vec3 lightDir;
 uniform	vec3 lightColor;
 
+#ifdef DIFFUSE_MAP
 uniform sampler2D diffuseTexture;
+#else
+uniform vec3 materialDiffuse;
+#endif
+#ifdef SPECULAR_MAP
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
-
-
-vec3 ambient;
-float ambientStrength = 0.2f;
-vec3 diffuse;
-vec3 specular;
-float specularStrength = 0.5f;
-float shininess = 32.0f;
-float shadow;
-
-void computeLightComponents()
-{
-	vec3 cameraPosEye = vec3(0.0f);
-
-	vec3 normalEye = normalize(fNormal);
-
-	vec3 lightDirN = normalize(lightDir);
+#else
+uniform vec3 materialSpecular;
+#endif
 
-	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+#include "common/lighting.glsl"
 
-	ambient = ambientStrength * lightColor;
+#ifdef SHADOWS
+#include "common/shadows.glsl"
+#endif
 
-	diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+#ifdef FOG
+#include "common/fog.glsl"
+#endif
 
-	vec3 reflection = reflect(-lightDirN, normalEye);
-	float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
-	specular = specularStrength * specCoeff * lightColor;
+vec3 diffuseColor()
+{
+#ifdef DIFFUSE_MAP
+	return texture(diffuseTexture, fTexCoords).rgb;
+#else
+	return materialDiffuse;
+#endif
 }
 
-float computeShadow() {
-	vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	normalizedCoords = normalizedCoords * 0.5 + 0.5;
-	float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
-	float currentDepth = normalizedCoords.z;
-	float bias = 0.005f;
-	float shadow = currentDepth - bias > closestDepth ? 1.0f : 0.0f;
-	return shadow;
+vec3 specularColor()
+{
+#ifdef SPECULAR_MAP
+	return texture(specularTexture, fTexCoords).rgb;
+#else
+	return materialSpecular;
+#endif
 }
 
-float computeFog()
+#ifdef SKYDOME
+// the dome is the backdrop: unlit, unshadowed and never fogged
+void main()
 {
-	float fogDensity = 0.015f;
-	float fragmentDistance = length(fPosEye.xyz);
-	float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
-	return clamp(fogFactor, 0.0f, 1.0f);
+	fColor = vec4(diffuseColor(), 1.0f);
 }
-
+#else
 void main()
 {
 	computeLightComponents();
 
-	vec3 baseColor = vec3(0.9f, 0.35f, 0.0f); // orange
-
-	ambient *= texture(diffuseTexture, fTexCoords).rgb;
-	diffuse *= texture(diffuseTexture, fTexCoords).rgb;
-	specular *= texture(specularTexture, fTexCoords).rgb;
+	vec3 albedo = diffuseColor();
+	ambient *= albedo;
+	diffuse *= albedo;
+	specular *= specularColor();
 
+	float shadow = 0.0f;
+#ifdef SHADOWS
 	shadow = computeShadow();
+#endif
 
 	vec3 color = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular, 1.0f);
 
+#ifdef FOG
 	float fogFactor = computeFog();
 	vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f); // Gray fog
 
 	fColor = mix(fogColor, vec4(color, 1.0f), fogFactor);
-}
\ No newline at end of file
+#else
+	fColor = vec4(color, 1.0f);
+#endif
+}
+#endif
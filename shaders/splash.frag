@@ -1,5 +1,7 @@
 #version 410 core
 
+in float fade;
+
 out vec4 FragColor;
 
 void main() {
@@ -9,5 +11,5 @@ void main() {
         discard;
     }
     
-    FragColor = vec4(0.9, 0.9, 1.0, 0.4);
-} 
\ No newline at end of file
+    FragColor = vec4(0.9, 0.9, 1.0, 0.4 * fade);
+}
@@ -1,11 +1,26 @@
 #version 410 core
 
+// per instance: where the drop landed and when
 layout(location = 0) in vec3 position;
+layout(location = 1) in float birthTime;
 
 uniform mat4 projection;
 uniform mat4 view;
+uniform float time;
+uniform float lifetime;
+uniform int dropsPerSplash;
+
+out float fade;
 
 void main() {
-    gl_Position = projection * view * vec4(position, 1.0);
-    gl_PointSize = 4.0;
-} 
\ No newline at end of file
+    float progress = clamp((time - birthTime) / lifetime, 0.0, 1.0);
+
+    // droplets fan out in a ring and follow a small arc, rotated per splash
+    float angle = (float(gl_VertexID) + fract(birthTime * 7.31)) * 6.2831853 / float(dropsPerSplash);
+    vec3 offset = vec3(cos(angle), 0.0, sin(angle)) * (0.35 * progress);
+    offset.y = 1.2 * progress * (1.0 - progress);
+
+    gl_Position = projection * view * vec4(position + offset, 1.0);
+    gl_PointSize = mix(4.0, 1.0, progress);
+    fade = 1.0 - progress;
+}
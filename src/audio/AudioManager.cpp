@@ -1,9 +1,12 @@
 #include "AudioManager.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 #include <sndfile.h>
 
-AudioManager::AudioManager() : device(nullptr), context(nullptr), isInitialized(false) {
+AudioManager::AudioManager() : firstFreeVoice(-1), voicesStarted(0), listenerPosition(0.0f), droppedCommands(0),
+    isInitialized(false), running(false), device(nullptr), context(nullptr), deviceSampleRate(0) {
 }
 
 AudioManager::~AudioManager() {
@@ -11,33 +14,80 @@ AudioManager::~AudioManager() {
 }
 
 bool AudioManager::initialize() {
-    device = alcOpenDevice(nullptr);
-    if (!device) {
-        std::cerr << "Failed to open audio device" << std::endl;
+    std::promise<bool> ready;
+    std::future<bool> opened = ready.get_future();
+    running = true;
+    // the thread owns the promise, set_value may still be running after get() returns
+    audioThread = std::thread(&AudioManager::audioThreadMain, this, std::move(ready));
+    if (!opened.get()) {
+        audioThread.join();
+        running = false;
         return false;
     }
 
-    context = alcCreateContext(device, nullptr);
-    if (!context) {
-        std::cerr << "Failed to create audio context" << std::endl;
-        return false;
+    for (int i = 0; i < MAX_VOICES; i++) {
+        voices[i].generation = 0;
+        voices[i].active = false;
+        voices[i].nextFree = i + 1 < MAX_VOICES ? i + 1 : -1;
     }
-
-    if (!alcMakeContextCurrent(context)) {
-        std::cerr << "Failed to make context current" << std::endl;
-        return false;
+    firstFreeVoice = 0;
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        sourceVoices[i] = -1;
+        sourceGenerations[i] = 0;
     }
+    startTime = std::chrono::steady_clock::now();
 
-    alGenSources(1, &source);
-    if (!checkError("Source generation")) {
+    isInitialized = true;
+    return true;
+}
+
+bool AudioManager::loadSoundBank(const std::string& filename) {
+    if (!isInitialized) return false;
+
+    SoundBank* bank = new SoundBank();
+    if (!bank->open(filename)) {
+        delete bank;
         return false;
     }
+    if (deviceSampleRate > 0 && bank->getSampleRate() != (uint32_t)deviceSampleRate) {
+        std::cout << "Sound bank " << filename << " is at " << bank->getSampleRate() << " Hz, the device runs at "
+                  << deviceSampleRate << " Hz; rebuild it to skip resampling" << std::endl;
+    }
 
-    isInitialized = true;
+    for (uint32_t i = 0; i < bank->getClipCount(); i++) {
+        const SoundBank::Clip& clip = bank->getClip(i);
+        Command command = {};
+        command.type = Command::Type::UploadSound;
+        command.sound = (SoundId)soundDurations.size();
+        command.data = bank->getSamples(i);
+        command.size = (ALsizei)((size_t)clip.frames * clip.channels * sizeof(int16_t));
+        command.format = (clip.channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+        command.sampleRate = bank->getSampleRate();
+        if (!submit(command)) {
+            continue;
+        }
+        bankSounds[clip.name] = command.sound;
+        soundDurations.push_back((float)clip.frames / bank->getSampleRate());
+    }
+    banks.push_back(bank);
     return true;
 }
 
-bool AudioManager::loadSound(const std::string& filename, ALuint& buffer) {
+bool AudioManager::loadSound(const std::string& filename, SoundId& sound) {
+    if (!isInitialized) return false;
+
+    // banks name their clips after the file, without directory or extension
+    size_t nameStart = filename.find_last_of("/\\");
+    nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+    size_t extension = filename.find_last_of('.');
+    size_t length = extension == std::string::npos || extension < nameStart ? std::string::npos : extension - nameStart;
+    std::string name = filename.substr(nameStart, length);
+    auto packed = bankSounds.find(name);
+    if (packed != bankSounds.end()) {
+        sound = packed->second;
+        return true;
+    }
+
     SF_INFO fileInfo;
     SNDFILE* file = sf_open(filename.c_str(), SFM_READ, &fileInfo);
     if (!file) {
@@ -45,52 +95,543 @@ bool AudioManager::loadSound(const std::string& filename, ALuint& buffer) {
         return false;
     }
 
-    std::vector<short> samples(fileInfo.frames * fileInfo.channels);
-    sf_read_short(file, samples.data(), samples.size());
+    std::vector<short>* samples = new std::vector<short>(fileInfo.frames * fileInfo.channels);
+    sf_read_short(file, samples->data(), samples->size());
     sf_close(file);
 
-    alGenBuffers(1, &buffer);
-    buffers.push_back(buffer);
+    Command command = {};
+    command.type = Command::Type::UploadSound;
+    command.sound = (SoundId)soundDurations.size();
+    command.samples = samples;
+    command.data = samples->data();
+    command.size = (ALsizei)(samples->size() * sizeof(short));
+    command.format = (fileInfo.channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    command.sampleRate = fileInfo.samplerate;
+    if (!submit(command)) {
+        delete samples;
+        return false;
+    }
+    sound = (SoundId)soundDurations.size();
+    soundDurations.push_back((float)fileInfo.frames / fileInfo.samplerate);
+    return true;
+}
+
+bool AudioManager::openStream(const std::string& filename, AudioStream*& stream) {
+    if (!isInitialized) return false;
+
+    stream = new AudioStream();
+    if (!stream->open(filename)) {
+        delete stream;
+        stream = nullptr;
+        return false;
+    }
+    streams.push_back(stream);
+    return true;
+}
 
-    ALenum format = (fileInfo.channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-    alBufferData(buffer, format, samples.data(), 
-                samples.size() * sizeof(short), fileInfo.samplerate);
+void AudioManager::playStream(AudioStream* stream, bool loop) {
+    if (!isInitialized || !stream) return;
 
-    return checkError("Buffer loading");
+    Command command = {};
+    command.type = Command::Type::PlayStream;
+    command.stream = stream;
+    command.loop = loop;
+    submit(command);
 }
 
-void AudioManager::playSound(ALuint buffer, bool loop) {
+void AudioManager::stopStream(AudioStream* stream) {
+    if (!isInitialized || !stream) return;
+
+    Command command = {};
+    command.type = Command::Type::StopStream;
+    command.stream = stream;
+    submit(command);
+}
+
+void AudioManager::update() {
     if (!isInitialized) return;
 
-    alSourcei(source, AL_BUFFER, buffer);
-    alSourcei(source, AL_LOOPING, loop ? AL_TRUE : AL_FALSE);
-    alSourcePlay(source);
+    // the audio thread already stopped these, only the bookkeeping is left
+    FinishedSource finished;
+    while (finishedSources.pop(finished)) {
+        int voice = sourceVoices[finished.index];
+        if (voice >= 0 && sourceGenerations[finished.index] == finished.generation) {
+            sourceVoices[finished.index] = -1;
+            voices[voice].source = -1;
+            releaseVoice(voice);
+        }
+    }
+
+    assignSources();
+}
+
+VoiceHandle AudioManager::playSound(SoundId sound, bool loop, VoicePriority priority) {
+    return startVoice(sound, loop, priority, false, glm::vec3(0.0f));
+}
+
+VoiceHandle AudioManager::playSoundAt(SoundId sound, const glm::vec3& position, bool loop, VoicePriority priority) {
+    return startVoice(sound, loop, priority, true, position);
 }
 
-void AudioManager::stopSound() {
+void AudioManager::stopSound(VoiceHandle voice) {
+    if (!isInitialized || !isCurrent(voice)) return;
+
+    if (voices[voice.index].source >= 0) {
+        unbindSource(voice.index);
+    }
+    releaseVoice(voice.index);
+}
+
+void AudioManager::setVolume(VoiceHandle voice, float volume) {
+    if (!isInitialized || !isCurrent(voice)) return;
+
+    Voice& state = voices[voice.index];
+    state.gain = volume;
+    if (state.source < 0) return;
+
+    Command command = {};
+    command.type = Command::Type::SetGain;
+    command.source = state.source;
+    command.generation = sourceGenerations[state.source];
+    command.gain = volume;
+    submit(command);
+}
+
+void AudioManager::setPosition(VoiceHandle voice, const glm::vec3& position) {
+    if (!isInitialized || !isCurrent(voice)) return;
+
+    // a voice moving out of range keeps its source until the next update()
+    Voice& state = voices[voice.index];
+    state.position = position;
+    state.positional = true;
+    if (state.source < 0) return;
+
+    Command command = {};
+    command.type = Command::Type::SetPosition;
+    command.source = state.source;
+    command.generation = sourceGenerations[state.source];
+    command.position[0] = position.x;
+    command.position[1] = position.y;
+    command.position[2] = position.z;
+    submit(command);
+}
+
+void AudioManager::setListener(const glm::vec3& position, const glm::vec3& forward, const glm::vec3& up) {
     if (!isInitialized) return;
-    alSourceStop(source);
+
+    listenerPosition = position;
+
+    Command command = {};
+    command.type = Command::Type::SetListener;
+    command.position[0] = position.x;
+    command.position[1] = position.y;
+    command.position[2] = position.z;
+    command.orientation[0] = forward.x;
+    command.orientation[1] = forward.y;
+    command.orientation[2] = forward.z;
+    command.orientation[3] = up.x;
+    command.orientation[4] = up.y;
+    command.orientation[5] = up.z;
+    submit(command);
+}
+
+bool AudioManager::isPlaying(VoiceHandle voice) const {
+    return isInitialized && isCurrent(voice);
 }
 
 void AudioManager::setVolume(float volume) {
     if (!isInitialized) return;
-    alSourcef(source, AL_GAIN, volume);
+
+    Command command = {};
+    command.type = Command::Type::SetMasterGain;
+    command.gain = volume;
+    submit(command);
 }
 
 void AudioManager::cleanup() {
     if (isInitialized) {
-        alSourceStop(source);
-        alDeleteSources(1, &source);
-        
-        for (ALuint buffer : buffers) {
-            alDeleteBuffers(1, &buffer);
+        // the audio thread runs the remaining commands and closes the device itself
+        running = false;
+        audioThread.join();
+
+        for (AudioStream* stream : streams) {
+            delete stream;
+        }
+        streams.clear();
+        // only unmapped once the audio thread is done uploading from them
+        for (SoundBank* bank : banks) {
+            delete bank;
+        }
+        banks.clear();
+        bankSounds.clear();
+        if (droppedCommands > 0) {
+            std::cerr << "Audio command queue was full, dropped " << droppedCommands << " commands" << std::endl;
+        }
+        isInitialized = false;
+    }
+}
+
+double AudioManager::getTime() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+bool AudioManager::submit(const Command& command) {
+    // never wait on the audio thread, a full queue loses the command instead
+    if (!commands.push(command)) {
+        droppedCommands++;
+        return false;
+    }
+    return true;
+}
+
+VoiceHandle AudioManager::startVoice(SoundId sound, bool loop, VoicePriority priority, bool positional,
+                                     const glm::vec3& position) {
+    if (!isInitialized || sound >= soundDurations.size()) return VoiceHandle();
+
+    int index = allocateVoice(priority);
+    if (index < 0) {
+        return VoiceHandle();
+    }
+
+    Voice& voice = voices[index];
+    voice.priority = priority;
+    voice.looping = loop;
+    voice.startOrder = voicesStarted++;
+    voice.sound = sound;
+    voice.gain = 1.0f;
+    voice.position = position;
+    voice.positional = positional;
+    voice.startTime = getTime();
+    voice.source = -1;
+
+    // start right away when a source is free, otherwise update() decides
+    float distance;
+    if (isAudible(voice, distance)) {
+        bindSource(index, voice.startTime);
+    }
+
+    VoiceHandle handle;
+    handle.index = index;
+    handle.generation = voice.generation;
+    return handle;
+}
+
+int AudioManager::allocateVoice(VoicePriority priority) {
+    if (firstFreeVoice >= 0) {
+        int index = firstFreeVoice;
+        firstFreeVoice = voices[index].nextFree;
+        voices[index].active = true;
+        return index;
+    }
+
+    // bounded by MAX_VOICES, only reached when every voice is busy
+    int victim = -1;
+    for (int i = 0; i < MAX_VOICES; i++) {
+        const Voice& voice = voices[i];
+        if (voice.priority > priority) continue;
+        if (victim < 0 || voice.priority < voices[victim].priority ||
+            (voice.priority == voices[victim].priority && voice.startOrder < voices[victim].startOrder)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return -1;
+    }
+
+    if (voices[victim].source >= 0) {
+        unbindSource(victim);
+    }
+    releaseVoice(victim);
+    firstFreeVoice = voices[victim].nextFree;
+    voices[victim].active = true;
+    return victim;
+}
+
+void AudioManager::releaseVoice(int index) {
+    Voice& voice = voices[index];
+    voice.active = false;
+    voice.generation++;
+    voice.nextFree = firstFreeVoice;
+    firstFreeVoice = index;
+}
+
+bool AudioManager::isCurrent(VoiceHandle voice) const {
+    return voice.index < MAX_VOICES && voices[voice.index].active &&
+           voices[voice.index].generation == voice.generation;
+}
+
+bool AudioManager::isAudible(const Voice& voice, float& distance) const {
+    distance = voice.positional ? glm::length(voice.position - listenerPosition) : 0.0f;
+    // a little slack for real voices so one sitting on the edge does not flap
+    float radius = voice.source >= 0 ? AUDIBLE_RADIUS * 1.1f : AUDIBLE_RADIUS;
+    return distance <= radius;
+}
+
+void AudioManager::assignSources() {
+    double now = getTime();
+    int candidates[MAX_VOICES];
+    float distances[MAX_VOICES];
+    bool wanted[MAX_VOICES];
+    int count = 0;
+
+    for (int i = 0; i < MAX_VOICES; i++) {
+        wanted[i] = false;
+        Voice& voice = voices[i];
+        if (!voice.active) continue;
+        // real one-shots are reported by the audio thread, virtual ones end on the clock
+        if (voice.source < 0 && !voice.looping && now - voice.startTime >= soundDurations[voice.sound]) {
+            releaseVoice(i);
+            continue;
+        }
+        if (isAudible(voice, distances[i])) {
+            candidates[count++] = i;
+        }
+    }
+
+    // most important first: priority, then the closest, then the newest
+    std::sort(candidates, candidates + count, [&](int a, int b) {
+        if (voices[a].priority != voices[b].priority) return voices[a].priority > voices[b].priority;
+        if (distances[a] != distances[b]) return distances[a] < distances[b];
+        return voices[a].startOrder > voices[b].startOrder;
+    });
+    for (int i = 0; i < std::min(count, MAX_SOURCES); i++) {
+        wanted[candidates[i]] = true;
+    }
+
+    // free the sources first so the newly wanted voices can take them
+    for (int i = 0; i < MAX_VOICES; i++) {
+        if (voices[i].active && voices[i].source >= 0 && !wanted[i]) {
+            unbindSource(i);
+        }
+    }
+    for (int i = 0; i < MAX_VOICES; i++) {
+        if (wanted[i] && voices[i].source < 0) {
+            bindSource(i, now);
+        }
+    }
+}
+
+bool AudioManager::bindSource(int index, double now) {
+    int source = -1;
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        if (sourceVoices[i] < 0) {
+            source = i;
+            break;
+        }
+    }
+    if (source < 0) {
+        return false;
+    }
+
+    // resume where the sound would be had it been playing all along
+    Voice& voice = voices[index];
+    float duration = soundDurations[voice.sound];
+    float offset = (float)(now - voice.startTime);
+    if (voice.looping && duration > 0.0f) {
+        offset = std::fmod(offset, duration);
+    }
+
+    Command command = {};
+    command.type = Command::Type::Play;
+    command.source = source;
+    command.generation = ++sourceGenerations[source];
+    command.sound = voice.sound;
+    command.loop = voice.looping;
+    command.positional = voice.positional;
+    command.gain = voice.gain;
+    command.offset = offset;
+    command.position[0] = voice.position.x;
+    command.position[1] = voice.position.y;
+    command.position[2] = voice.position.z;
+    if (!submit(command)) {
+        return false;
+    }
+    sourceVoices[source] = index;
+    voice.source = source;
+    return true;
+}
+
+void AudioManager::unbindSource(int index) {
+    Voice& voice = voices[index];
+
+    Command command = {};
+    command.type = Command::Type::Stop;
+    command.source = voice.source;
+    command.generation = sourceGenerations[voice.source];
+    submit(command);
+
+    // even if the stop was dropped, the next Play on the source replaces the sound
+    sourceVoices[voice.source] = -1;
+    voice.source = -1;
+}
+
+void AudioManager::audioThreadMain(std::promise<bool> ready) {
+    bool opened = openDevice();
+    ready.set_value(opened);
+    if (!opened) {
+        return;
+    }
+
+    while (true) {
+        // read the flag first so commands pushed before cleanup still run
+        bool stopping = !running;
+
+        Command command;
+        while (commands.pop(command)) {
+            execute(command);
         }
-        buffers.clear();
+        if (stopping) {
+            break;
+        }
+
+        for (AudioStream* stream : playingStreams) {
+            stream->update();
+        }
+        reportFinishedSources();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_TICK_MS));
+    }
+
+    closeDevice();
+}
+
+bool AudioManager::openDevice() {
+    device = alcOpenDevice(nullptr);
+    if (!device) {
+        std::cerr << "Failed to open audio device" << std::endl;
+        return false;
+    }
 
-        alcMakeContextCurrent(nullptr);
+    context = alcCreateContext(device, nullptr);
+    if (!context) {
+        std::cerr << "Failed to create audio context" << std::endl;
+        alcCloseDevice(device);
+        return false;
+    }
+
+    if (!alcMakeContextCurrent(context)) {
+        std::cerr << "Failed to make context current" << std::endl;
         alcDestroyContext(context);
         alcCloseDevice(device);
+        return false;
+    }
+
+    alcGetIntegerv(device, ALC_FREQUENCY, 1, &deviceSampleRate);
+    alDistanceModel(AL_LINEAR_DISTANCE_CLAMPED);
+
+    // all sources are created up front, playing a sound only rebinds one
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        alGenSources(1, &sources[i].source);
+        alSourcef(sources[i].source, AL_REFERENCE_DISTANCE, REFERENCE_DISTANCE);
+        alSourcef(sources[i].source, AL_MAX_DISTANCE, AUDIBLE_RADIUS);
+        sources[i].generation = 0;
+        sources[i].playing = false;
+        sources[i].looping = false;
     }
+    return checkError("Source generation");
+}
+
+void AudioManager::execute(const Command& command) {
+    Source* source = command.source < MAX_SOURCES ? &sources[command.source] : nullptr;
+    // commands for a source that has been rebound since are stale
+    bool current = source && source->generation == command.generation;
+
+    switch (command.type) {
+        case Command::Type::UploadSound: {
+            ALuint buffer;
+            alGenBuffers(1, &buffer);
+            alBufferData(buffer, command.format, command.data, command.size, command.sampleRate);
+            checkError("Buffer loading");
+            if (buffers.size() <= command.sound) {
+                buffers.resize(command.sound + 1, 0);
+            }
+            buffers[command.sound] = buffer;
+            delete command.samples;
+            break;
+        }
+        case Command::Type::Play:
+            if (!source || command.sound >= buffers.size()) break;
+            alSourceStop(source->source);
+            alSourcei(source->source, AL_BUFFER, buffers[command.sound]);
+            alSourcei(source->source, AL_LOOPING, command.loop ? AL_TRUE : AL_FALSE);
+            alSourcef(source->source, AL_GAIN, command.gain);
+            // non-positional sounds sit on the listener
+            alSourcei(source->source, AL_SOURCE_RELATIVE, command.positional ? AL_FALSE : AL_TRUE);
+            alSource3f(source->source, AL_POSITION, command.position[0], command.position[1], command.position[2]);
+            alSourcef(source->source, AL_SEC_OFFSET, command.offset);
+            alSourcePlay(source->source);
+            source->generation = command.generation;
+            source->playing = true;
+            source->looping = command.loop;
+            break;
+        case Command::Type::Stop:
+            if (!current) break;
+            alSourceStop(source->source);
+            alSourcei(source->source, AL_BUFFER, 0);
+            source->playing = false;
+            break;
+        case Command::Type::SetGain:
+            if (current) alSourcef(source->source, AL_GAIN, command.gain);
+            break;
+        case Command::Type::SetPosition:
+            if (!current) break;
+            alSourcei(source->source, AL_SOURCE_RELATIVE, AL_FALSE);
+            alSource3f(source->source, AL_POSITION, command.position[0], command.position[1], command.position[2]);
+            break;
+        case Command::Type::SetListener:
+            alListener3f(AL_POSITION, command.position[0], command.position[1], command.position[2]);
+            alListenerfv(AL_ORIENTATION, command.orientation);
+            break;
+        case Command::Type::SetMasterGain:
+            alListenerf(AL_GAIN, command.gain);
+            break;
+        case Command::Type::PlayStream:
+            command.stream->play(command.loop);
+            if (std::find(playingStreams.begin(), playingStreams.end(), command.stream) == playingStreams.end()) {
+                playingStreams.push_back(command.stream);
+            }
+            break;
+        case Command::Type::StopStream:
+            command.stream->stop();
+            playingStreams.erase(std::remove(playingStreams.begin(), playingStreams.end(), command.stream),
+                                 playingStreams.end());
+            break;
+    }
+}
+
+void AudioManager::reportFinishedSources() {
+    // one-shots hand their voice back once the source has played out
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        Source& source = sources[i];
+        if (!source.playing || source.looping) continue;
+        ALint state;
+        alGetSourcei(source.source, AL_SOURCE_STATE, &state);
+        // a full queue is retried on the next tick
+        if (state == AL_STOPPED && finishedSources.push({ (uint32_t)i, source.generation })) {
+            source.playing = false;
+        }
+    }
+}
+
+void AudioManager::closeDevice() {
+    // the render thread is waiting in cleanup(), so its stream list is safe to read
+    for (AudioStream* stream : streams) {
+        stream->close();
+    }
+    playingStreams.clear();
+
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        alSourceStop(sources[i].source);
+        alDeleteSources(1, &sources[i].source);
+    }
+    for (ALuint buffer : buffers) {
+        alDeleteBuffers(1, &buffer);
+    }
+    buffers.clear();
+
+    alcMakeContextCurrent(nullptr);
+    alcDestroyContext(context);
+    alcCloseDevice(device);
 }
 
 bool AudioManager::checkError(const std::string& msg) {
@@ -100,4 +641,4 @@ bool AudioManager::checkError(const std::string& msg) {
         return false;
     }
     return true;
-} 
\ No newline at end of file
+}
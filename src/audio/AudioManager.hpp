@@ -9,29 +9,187 @@
     #include <AL/alc.h>
 #endif
 
+#include "AudioStream.hpp"
+#include "SoundBank.hpp"
+#include "SpscQueue.hpp"
+#include <glm/glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
+// A voice slot plus the generation it was issued for; once the voice finishes or
+// is stolen the generation moves on and the handle silently stops controlling it.
+struct VoiceHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != UINT32_MAX; }
+};
+
+// loaded sound, resolved to an AL buffer on the audio thread
+typedef uint32_t SoundId;
+
+// The OpenAL device, context and every AL call live on a dedicated audio thread.
+// The public methods only record the request in a lock-free queue and return, so
+// a blocking backend never stalls the frame. They must all be called from one
+// thread (the render thread). Handles are issued right away on the calling side,
+// which keeps its own copy of the voice pool bookkeeping.
+//
+// Voices are logical: only the MAX_SOURCES most important audible ones are backed
+// by an OpenAL source. Positional voices beyond AUDIBLE_RADIUS of the listener,
+// or crowded out by higher priority ones, stay virtual. Their clock keeps running
+// and they resume at the right offset once a source is theirs again.
 class AudioManager {
 public:
+    // a full pool steals the lowest priority voice, oldest first, never a higher one
+    enum VoicePriority { PRIORITY_LOW = 0, PRIORITY_NORMAL = 1, PRIORITY_HIGH = 2 };
+    static constexpr int MAX_VOICES = 128;
+    static constexpr int MAX_SOURCES = 32;
+    // positional voices fade linearly from full gain at REFERENCE_DISTANCE to
+    // silence at AUDIBLE_RADIUS, so virtualizing them there is inaudible
+    static constexpr float REFERENCE_DISTANCE = 2.0f;
+    static constexpr float AUDIBLE_RADIUS = 30.0f;
+
     AudioManager();
     ~AudioManager();
 
+    // starts the audio thread and waits for it to open the device
     bool initialize();
-    bool loadSound(const std::string& filename, ALuint& buffer);
-    void playSound(ALuint buffer, bool loop = false);
-    void stopSound();
+    // uploads every clip of a bank built by tools/SoundBankBuilder straight from
+    // the mapped file; the bank stays mapped until cleanup
+    bool loadSoundBank(const std::string& filename);
+    // takes the clip of the same name from a loaded bank, otherwise decodes the
+    // whole file here; the upload happens on the audio thread
+    bool loadSound(const std::string& filename, SoundId& sound);
+    // long tracks: decoded a few chunks at a time while playing, on their own source
+    bool openStream(const std::string& filename, AudioStream*& stream);
+    void playStream(AudioStream* stream, bool loop = false);
+    void stopStream(AudioStream* stream);
+    // returns finished voices to the pool and picks which voices get a real
+    // source, call once per frame after setListener
+    void update();
+    // every sound gets its own voice from a fixed pool, without allocating
+    VoiceHandle playSound(SoundId sound, bool loop = false, VoicePriority priority = PRIORITY_NORMAL);
+    // world space emitter, only mono sounds are spatialized by OpenAL
+    VoiceHandle playSoundAt(SoundId sound, const glm::vec3& position, bool loop = false,
+                            VoicePriority priority = PRIORITY_NORMAL);
+    void stopSound(VoiceHandle voice);
+    void setVolume(VoiceHandle voice, float volume);
+    // makes the voice positional if it was not
+    void setPosition(VoiceHandle voice, const glm::vec3& position);
+    void setListener(const glm::vec3& position, const glm::vec3& forward, const glm::vec3& up);
+    // as of the last update(), the audio thread reports finished voices a little later
+    bool isPlaying(VoiceHandle voice) const;
+    // master volume for every voice and stream
     void setVolume(float volume);
     void cleanup();
 
 private:
+    struct Command {
+        enum class Type { UploadSound, Play, Stop, SetGain, SetPosition, SetListener, SetMasterGain,
+                          PlayStream, StopStream };
+        Type type;
+        uint32_t source;
+        uint32_t generation;
+        SoundId sound;
+        bool loop;
+        bool positional;
+        float gain;
+        float offset;                   // seconds into the sound to start from
+        float position[3];
+        float orientation[6];           // listener forward and up
+        AudioStream* stream;
+        std::vector<short>* samples;    // UploadSound from a file, freed by the audio thread
+        const void* data;               // UploadSound from a bank, or the samples
+        ALsizei size;
+        ALenum format;
+        ALsizei sampleRate;
+    };
+
+    // a one-shot source that played out, sent back from the audio thread
+    struct FinishedSource {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    // render thread side of the pool
+    struct Voice {
+        uint32_t generation;
+        VoicePriority priority;
+        bool active;
+        bool looping;
+        uint64_t startOrder;    // to steal the oldest among equals
+        int nextFree;           // free list link, -1 ends it
+        SoundId sound;
+        float gain;
+        glm::vec3 position;
+        bool positional;
+        double startTime;       // keeps virtual voices in step with real time
+        int source;             // -1 while virtual
+    };
+
+    // audio thread side of the sources
+    struct Source {
+        ALuint source;
+        uint32_t generation;    // of the last Play executed on it
+        bool playing;
+        bool looping;
+    };
+
+    static constexpr int AUDIO_TICK_MS = 5;
+
+    Voice voices[MAX_VOICES];
+    int firstFreeVoice;
+    uint64_t voicesStarted;
+    // voice bound to each source, -1 when free, and the binding generation
+    int sourceVoices[MAX_SOURCES];
+    uint32_t sourceGenerations[MAX_SOURCES];
+    std::vector<float> soundDurations;
+    std::vector<SoundBank*> banks;
+    std::map<std::string, SoundId> bankSounds;
+    glm::vec3 listenerPosition;
+    std::chrono::steady_clock::time_point startTime;
+    std::vector<AudioStream*> streams;
+    long droppedCommands;
+    bool isInitialized;
+
+    std::thread audioThread;
+    std::atomic<bool> running;
+    SpscQueue<Command, 1024> commands;
+    SpscQueue<FinishedSource, 64> finishedSources;
+
+    // only touched by the audio thread
     ALCdevice* device;
     ALCcontext* context;
-    ALuint source;
+    // written before initialize() returns, read-only afterwards
+    ALCint deviceSampleRate;
+    Source sources[MAX_SOURCES];
     std::vector<ALuint> buffers;
-    bool isInitialized;
+    std::vector<AudioStream*> playingStreams;
 
+    bool submit(const Command& command);
+    VoiceHandle startVoice(SoundId sound, bool loop, VoicePriority priority, bool positional,
+                           const glm::vec3& position);
+    int allocateVoice(VoicePriority priority);
+    void releaseVoice(int index);
+    bool isCurrent(VoiceHandle voice) const;
+    bool isAudible(const Voice& voice, float& distance) const;
+    void assignSources();
+    bool bindSource(int voice, double now);
+    void unbindSource(int voice);
+    double getTime() const;
+
+    void audioThreadMain(std::promise<bool> ready);
+    bool openDevice();
+    void execute(const Command& command);
+    void reportFinishedSources();
+    void closeDevice();
     bool checkError(const std::string& msg);
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,187 @@
+#include "AudioStream.hpp"
+#include <iostream>
+
+AudioStream::AudioStream() : file(nullptr), format(AL_FORMAT_MONO16), source(0), playing(false),
+    decoding(false), looping(false), endOfFile(false) {
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        buffers[i] = 0;
+    }
+}
+
+AudioStream::~AudioStream() {
+    close();
+}
+
+bool AudioStream::open(const std::string& filename) {
+    file = sf_open(filename.c_str(), SFM_READ, &fileInfo);
+    if (!file) {
+        std::cerr << "Failed to open sound file: " << filename << std::endl;
+        return false;
+    }
+    format = (fileInfo.channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+
+    for (int i = 0; i < DECODE_AHEAD; i++) {
+        freeChunks.emplace_back(CHUNK_FRAMES * fileInfo.channels);
+    }
+    return true;
+}
+
+void AudioStream::play(bool loop) {
+    if (!file) return;
+    stop();
+
+    // created on first play, by the thread owning the AL context
+    if (!source) {
+        alGenSources(1, &source);
+        alGenBuffers(BUFFER_COUNT, buffers);
+        // ambient tracks follow the listener
+        alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+    }
+
+    looping = loop;
+    endOfFile = false;
+    sf_seek(file, 0, SEEK_SET);
+
+    // prime the queue synchronously, the decoder takes over from here
+    std::vector<short>& chunk = freeChunks.back();
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        if (!decodeChunk(chunk)) {
+            break;
+        }
+        alBufferData(buffers[i], format, chunk.data(), (ALsizei)(chunk.size() * sizeof(short)),
+                     fileInfo.samplerate);
+        alSourceQueueBuffers(source, 1, &buffers[i]);
+    }
+    chunk.resize(CHUNK_FRAMES * fileInfo.channels);
+    alSourcePlay(source);
+    playing = true;
+
+    decoding = true;
+    decoder = std::thread(&AudioStream::decodeLoop, this);
+}
+
+void AudioStream::stop() {
+    stopDecoder();
+    if (!playing) return;
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    idleBuffers.clear();
+    playing = false;
+
+    // hand every chunk back for the next play
+    for (std::vector<short>& chunk : decodedChunks) {
+        freeChunks.push_back(std::move(chunk));
+    }
+    decodedChunks.clear();
+}
+
+void AudioStream::setVolume(float volume) {
+    if (source) {
+        alSourcef(source, AL_GAIN, volume);
+    }
+}
+
+void AudioStream::update() {
+    if (!playing) return;
+
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        idleBuffers.push_back(buffer);
+    }
+
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!idleBuffers.empty() && !decodedChunks.empty()) {
+            std::vector<short>& chunk = decodedChunks.front();
+            alBufferData(idleBuffers.back(), format, chunk.data(), (ALsizei)(chunk.size() * sizeof(short)),
+                         fileInfo.samplerate);
+            alSourceQueueBuffers(source, 1, &idleBuffers.back());
+            idleBuffers.pop_back();
+            freeChunks.push_back(std::move(chunk));
+            decodedChunks.pop_front();
+        }
+        finished = endOfFile && decodedChunks.empty();
+    }
+    chunkFreed.notify_one();
+
+    ALint queued = 0;
+    ALint state = AL_STOPPED;
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING) {
+        if (queued > 0) {
+            // the decoder fell behind and the source ran dry, carry on from here
+            alSourcePlay(source);
+        } else if (finished) {
+            stop();
+        }
+    }
+}
+
+void AudioStream::close() {
+    stop();
+    if (source) {
+        alDeleteSources(1, &source);
+        alDeleteBuffers(BUFFER_COUNT, buffers);
+        source = 0;
+    }
+    if (file) {
+        sf_close(file);
+        file = nullptr;
+    }
+    freeChunks.clear();
+}
+
+bool AudioStream::decodeChunk(std::vector<short>& chunk) {
+    chunk.resize(CHUNK_FRAMES * fileInfo.channels);
+    sf_count_t frames = sf_readf_short(file, chunk.data(), CHUNK_FRAMES);
+    if (frames < CHUNK_FRAMES && looping) {
+        // wrap around inside the chunk so the loop point has no gap
+        sf_seek(file, 0, SEEK_SET);
+        frames += sf_readf_short(file, chunk.data() + frames * fileInfo.channels, CHUNK_FRAMES - frames);
+    }
+    chunk.resize(frames * fileInfo.channels);
+    return frames > 0;
+}
+
+void AudioStream::decodeLoop() {
+    while (true) {
+        std::vector<short> chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunkFreed.wait(lock, [this]() { return !decoding || !freeChunks.empty(); });
+            if (!decoding) {
+                return;
+            }
+            chunk = std::move(freeChunks.back());
+            freeChunks.pop_back();
+        }
+
+        // the file is only read here while the decoder runs
+        bool decoded = decodeChunk(chunk);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!decoded) {
+            freeChunks.push_back(std::move(chunk));
+            endOfFile = true;
+            return;
+        }
+        decodedChunks.push_back(std::move(chunk));
+    }
+}
+
+void AudioStream::stopDecoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoding = false;
+    }
+    chunkFreed.notify_one();
+    if (decoder.joinable()) {
+        decoder.join();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef AUDIO_STREAM_HPP
+#define AUDIO_STREAM_HPP
+
+#if defined(__APPLE__)
+    #include <OpenAL/al.h>
+#else
+    #include <AL/al.h>
+#endif
+
+#include <sndfile.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays a long file without decoding it up front. A background thread decodes
+// small chunks ahead of playback and update() feeds them through a short queue
+// of AL buffers on the source, so memory stays at a few chunks whatever the
+// track length. open() only touches the file; play, stop, update and close make
+// the AL calls and belong on the thread owning the context.
+class AudioStream {
+public:
+    AudioStream();
+    ~AudioStream();
+
+    bool open(const std::string& filename);
+    void play(bool loop);
+    void stop();
+    void setVolume(float volume);
+    // moves decoded chunks into the buffers the source has finished, call every frame
+    void update();
+    void close();
+
+    bool isPlaying() const { return playing; }
+
+private:
+    static const int BUFFER_COUNT = 4;      // AL buffers queued on the source
+    static const int DECODE_AHEAD = 4;      // decoded chunks waiting for a free buffer
+    static const int CHUNK_FRAMES = 8192;   // ~190 ms at 44.1 kHz
+
+    SNDFILE* file;
+    SF_INFO fileInfo;
+    ALenum format;
+    ALuint source;
+    ALuint buffers[BUFFER_COUNT];
+    std::vector<ALuint> idleBuffers;        // unqueued while the decoder was behind
+    bool playing;
+
+    std::thread decoder;
+    std::mutex mutex;
+    std::condition_variable chunkFreed;
+    std::deque<std::vector<short>> decodedChunks;
+    std::vector<std::vector<short>> freeChunks;     // recycled so decoding never allocates
+    bool decoding;
+    bool looping;
+    bool endOfFile;
+
+    bool decodeChunk(std::vector<short>& chunk);
+    void decodeLoop();
+    void stopDecoder();
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "SoundBank.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SoundBank::SoundBank() : mapping(nullptr), mappingSize(0), header(nullptr), clips(nullptr) {
+}
+
+SoundBank::~SoundBank() {
+    close();
+}
+
+bool SoundBank::open(const std::string& filename) {
+    close();
+
+    int descriptor = ::open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+        ::close(descriptor);
+        std::cerr << "Invalid sound bank: " << filename << std::endl;
+        return false;
+    }
+
+    // the mapping outlives the descriptor
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map sound bank: " << filename << std::endl;
+        return false;
+    }
+    mapping = data;
+    mappingSize = info.st_size;
+    header = static_cast<const Header*>(mapping);
+    clips = reinterpret_cast<const Clip*>(header + 1);
+
+    bool valid = header->magic == MAGIC && header->version == VERSION &&
+                 sizeof(Header) + (size_t)header->clipCount * sizeof(Clip) <= mappingSize;
+    for (uint32_t i = 0; valid && i < header->clipCount; i++) {
+        const Clip& clip = clips[i];
+        size_t bytes = (size_t)clip.frames * clip.channels * sizeof(int16_t);
+        valid = (clip.channels == 1 || clip.channels == 2) && clip.offset % DATA_ALIGNMENT == 0 &&
+                clip.offset <= mappingSize && bytes <= mappingSize - clip.offset &&
+                clip.name[NAME_LENGTH - 1] == '\0';
+    }
+    if (!valid) {
+        std::cerr << "Invalid sound bank: " << filename << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SoundBank::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        clips = nullptr;
+    }
+}
+
+const int16_t* SoundBank::getSamples(uint32_t index) const {
+    return reinterpret_cast<const int16_t*>(static_cast<const char*>(mapping) + clips[index].offset);
+}
@@ -0,0 +1,53 @@
+#ifndef SOUND_BANK_HPP
+#define SOUND_BANK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Many short clips packed into one file by tools/SoundBankBuilder: a header, a
+// table of clips, then 16-bit PCM already resampled to one rate. The loader maps
+// the file and hands the samples to OpenAL as they are, nothing is decoded or
+// copied at startup.
+class SoundBank {
+public:
+    static constexpr uint32_t MAGIC = 0x4b4e4253;    // "SBNK"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t NAME_LENGTH = 48;
+    static constexpr size_t DATA_ALIGNMENT = 16;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sampleRate;
+        uint32_t clipCount;
+    };
+
+    // the table follows the header, clip data follows the table
+    struct Clip {
+        char name[NAME_LENGTH];     // file name without directory or extension
+        uint32_t channels;
+        uint32_t frames;
+        uint64_t offset;            // bytes from the start of the file
+    };
+
+    SoundBank();
+    ~SoundBank();
+
+    bool open(const std::string& filename);
+    void close();
+
+    uint32_t getSampleRate() const { return header ? header->sampleRate : 0; }
+    uint32_t getClipCount() const { return header ? header->clipCount : 0; }
+    const Clip& getClip(uint32_t index) const { return clips[index]; }
+    // points into the mapping, valid until close()
+    const int16_t* getSamples(uint32_t index) const;
+
+private:
+    void* mapping;
+    size_t mappingSize;
+    const Header* header;
+    const Clip* clips;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed size single-producer single-consumer ring. push and pop never block or
+// allocate: each side only writes its own index and publishes it with a release
+// store, the other side reads it with an acquire load. One thread may push and
+// one other thread may pop, no more.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // false when full, the caller decides whether to drop or retry
+    bool push(const T& item) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        items[tail & (Capacity - 1)] = item;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[head & (Capacity - 1)];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // separate cache lines so the two threads do not false-share the indices
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    T items[Capacity];
+};
+
+#endif
@@ -21,6 +21,9 @@ namespace gps {
         glm::mat4 getProjectionMatrix();
         
         glm::vec3 getCameraPosition() const { return cameraPosition; }
+        glm::vec3 getCameraFrontDirection() const { return cameraFrontDirection; }
+        glm::vec3 getCameraUpDirection() const { return cameraUpDirection; }
+        float getFieldOfView() const { return fov; }
         
         void setPosition(const glm::vec3& position);
         void lookAt(const glm::vec3& target);
@@ -0,0 +1,82 @@
+#include "CameraPath.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+                                const glm::vec3& p3, float t) {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (-p0 + p2) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                       (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+    }
+
+    bool CameraPath::load(const std::string& fileName) {
+        std::ifstream file(fileName);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open camera path " << fileName << std::endl;
+            return false;
+        }
+
+        keyframes.clear();
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+
+            std::istringstream values(line);
+            Keyframe keyframe;
+            if (!(values >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+                        >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z)) {
+                std::cerr << fileName << ":" << lineNumber << ": expected 7 numbers" << std::endl;
+                continue;
+            }
+            keyframes.push_back(keyframe);
+        }
+
+        std::sort(keyframes.begin(), keyframes.end(),
+                  [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+
+        if (!isLoaded()) {
+            std::cerr << "Camera path " << fileName << " needs at least two keyframes" << std::endl;
+            return false;
+        }
+        std::cout << "Loaded camera path " << fileName << " (" << keyframes.size() << " keyframes, "
+                  << getDuration() << " s)" << std::endl;
+        return true;
+    }
+
+    float CameraPath::getDuration() const {
+        return keyframes.empty() ? 0.0f : keyframes.back().time - keyframes.front().time;
+    }
+
+    void CameraPath::sample(float t, glm::vec3& position, glm::vec3& target) const {
+        if (keyframes.empty()) {
+            return;
+        }
+
+        float time = glm::clamp(keyframes.front().time + t, keyframes.front().time, keyframes.back().time);
+        size_t segment = 0;
+        while (segment + 2 < keyframes.size() && keyframes[segment + 1].time <= time) {
+            segment++;
+        }
+
+        // the end points are repeated so the curve passes through the first and last keyframe
+        const Keyframe& k0 = keyframes[segment == 0 ? 0 : segment - 1];
+        const Keyframe& k1 = keyframes[segment];
+        const Keyframe& k2 = keyframes[std::min(segment + 1, keyframes.size() - 1)];
+        const Keyframe& k3 = keyframes[std::min(segment + 2, keyframes.size() - 1)];
+
+        float span = k2.time - k1.time;
+        float local = span > 0.0f ? (time - k1.time) / span : 0.0f;
+        position = catmullRom(k0.position, k1.position, k2.position, k3.position, local);
+        target = catmullRom(k0.target, k1.target, k2.target, k3.target, local);
+    }
+}
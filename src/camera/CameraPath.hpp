@@ -0,0 +1,35 @@
+#ifndef CameraPath_hpp
+#define CameraPath_hpp
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Camera flythrough through timed keyframes, interpolated with a uniform
+    // Catmull-Rom spline for both the eye position and the look-at target.
+    // File format, one keyframe per line ('#' starts a comment):
+    //     time  posX posY posZ  targetX targetY targetZ
+    class CameraPath {
+
+    public:
+        struct Keyframe {
+            float time;
+            glm::vec3 position;
+            glm::vec3 target;
+        };
+
+        bool load(const std::string& fileName);
+        bool isLoaded() const { return keyframes.size() >= 2; }
+        float getDuration() const;
+
+        // t is clamped to [0, duration]
+        void sample(float t, glm::vec3& position, glm::vec3& target) const;
+
+    private:
+        std::vector<Keyframe> keyframes;
+    };
+}
+
+#endif
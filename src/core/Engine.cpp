@@ -1,4 +1,9 @@
 #include "Engine.hpp"
+#include "TraceProfiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 
 glm::mat3 calculateNormalMatrix(const glm::mat4& modelView) {
@@ -7,13 +12,40 @@ glm::mat3 calculateNormalMatrix(const glm::mat4& modelView) {
     return normalMatrix;
 }
 
+bool isSphereInFrustum(const glm::mat4& viewProjection, const glm::vec3& center, float radius) {
+    // Gribb-Hartmann planes, left/right, bottom/top, near/far
+    for (int i = 0; i < 3; i++) {
+        for (float sign : {1.0f, -1.0f}) {
+            glm::vec4 plane(
+                viewProjection[0][3] + sign * viewProjection[0][i],
+                viewProjection[1][3] + sign * viewProjection[1][i],
+                viewProjection[2][3] + sign * viewProjection[2][i],
+                viewProjection[3][3] + sign * viewProjection[3][i]
+            );
+            plane /= glm::length(glm::vec3(plane));
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 Engine::Engine() : 
     glWindowWidth(1200), 
     glWindowHeight(900),
     glWindow(nullptr),
     camera(nullptr),
     controls(nullptr),
-    rainSystem(nullptr) {
+    rainSystem(nullptr),
+    splashSystem(nullptr),
+    frameDeltaTime(0.0f),
+    lastTitleUpdate(0.0),
+    shadowCascadeCount(3),
+    shadowResolution(768),
+    pcfGridSize(3),
+    pcfPoissonTaps(12),
+    pcfRadius(1.5f) {
 }
 
 Engine::~Engine() {
@@ -21,6 +53,31 @@ Engine::~Engine() {
 }
 
 bool Engine::init() {
+    bool benchmark = !options.benchmarkPath.empty();
+    if (benchmark && !options.replayPath.empty()) {
+        std::cerr << "--benchmark and --replay cannot be combined" << std::endl;
+        return false;
+    }
+    if (benchmark && options.fixedTimestep <= 0.0f) {
+        options.fixedTimestep = 1.0f / 60.0f;
+    }
+
+    if (!options.replayPath.empty()) {
+        if (!inputRecorder.startReplay(options.replayPath)) {
+            return false;
+        }
+        options.fixedTimestep = inputRecorder.getTimestep();
+    } else if (!options.recordPath.empty()) {
+        if (options.fixedTimestep <= 0.0f) {
+            options.fixedTimestep = 1.0f / 60.0f;
+        }
+        inputRecorder.startRecording(options.recordPath, options.fixedTimestep);
+    }
+    // rain spawning uses rand(), so recorded and replayed runs start from the same seed
+    if (inputRecorder.getMode() != InputRecorder::Mode::Idle || benchmark) {
+        srand(REPLAY_RANDOM_SEED);
+    }
+
     if (!initOpenGLWindow()) {
         return false;
     }
@@ -36,25 +93,131 @@ bool Engine::init() {
     initShaders();
     initUniforms();
     initFBO();
+    initFrameGraph();
 
     controls = new Controls(glWindow, *camera, pokemons, rainSystem, 
-                          audioManager, myCustomShader, lightShader, 
-                          projectionLoc, lightDir);
+                          audioManager, lightShader, lightDir);
     controls->setupCallbacks();
+    controls->setRecorder(&inputRecorder);
+
+    // without a path file presentation mode falls back to the built-in orbit
+    if (cameraPath.load(options.cameraPathFile)) {
+        controls->setCameraPath(&cameraPath);
+    } else if (benchmark) {
+        return false;
+    }
+    if (benchmark) {
+        startBenchmark();
+    }
 
     return true;
 }
 
 void Engine::run() {
+    uint32_t frame = 0;
+    double runStart = glfwGetTime();
+    double lastTime = runStart;
+
     while (!glfwWindowShouldClose(glWindow)) {
-        controls->processMovement();
+        double frameStart = glfwGetTime();
+        frameDeltaTime = options.fixedTimestep > 0.0f ? options.fixedTimestep : (float)(frameStart - lastTime);
+        lastTime = frameStart;
+        inputRecorder.setFrame(frame);
+
+        reloadChangedShaders();
+        controls->processMovement(frameDeltaTime);
+        updateAudio();
         renderScene();
+
+        // GPU results arrive a few frames late, so the title only refreshes twice a second
+        double now = glfwGetTime();
+        if (now - lastTitleUpdate > 0.5) {
+            std::string title = "OpenGL Shader Example - " + gpuProfiler.getSummary();
+            // the splash CPU cost is meant to stay bounded however hard it rains
+            if (splashSystem->getActiveCount() > 0) {
+                title += " | splash CPU " + std::to_string((int)splashSystem->getLastFrameMicroseconds()) + " us";
+            }
+            glfwSetWindowTitle(glWindow, title.c_str());
+            lastTitleUpdate = now;
+        }
+        if (controls->consumeTimingDumpRequest()) {
+            if (gpuProfiler.writeCsv("pass_timings.csv")) {
+                std::cout << "Pass timings written to pass_timings.csv" << std::endl;
+            }
+#ifdef ENABLE_TRACING
+            TraceProfiler::writeChromeTrace("trace.json");
+#endif
+        }
         
         glfwPollEvents();
+        // recorded events are fed at the same point live events arrive
+        if (inputRecorder.isReplaying()) {
+            inputRecorder.replayFrame(frame, *controls);
+            if (inputRecorder.isReplayFinished()) {
+                double seconds = glfwGetTime() - runStart;
+                std::cout << "Replay finished: " << frame + 1 << " frames in " << seconds << " s ("
+                          << seconds * 1000.0 / (frame + 1) << " ms per frame)" << std::endl;
+                glfwSetWindowShouldClose(glWindow, GL_TRUE);
+            }
+        }
         glfwSwapBuffers(glWindow);
+        frame++;
+
+        if (!options.benchmarkPath.empty()) {
+            benchmarkFrames.push_back({ controls->getPresentationTime(),
+                                        (float)((glfwGetTime() - frameStart) * 1000.0),
+                                        (float)gpuProfiler.getLastGpuFrameMilliseconds() });
+            if (!controls->isPresenting()) {
+                finishBenchmark();
+                glfwSetWindowShouldClose(glWindow, GL_TRUE);
+            }
+        }
     }
 }
 
+void Engine::startBenchmark() {
+    controls->setLiveInputEnabled(false);
+    controls->setWind(BENCHMARK_WIND_ANGLE, BENCHMARK_WIND_STRENGTH);
+    if (!rainSystem->isEnabled()) {
+        rainSystem->toggleEnabled();
+    }
+    controls->startPresentation();
+    std::cout << "Benchmark: flying " << options.cameraPathFile << " ("
+              << cameraPath.getDuration() << " s at " << options.fixedTimestep << " s per frame)" << std::endl;
+}
+
+void Engine::finishBenchmark() {
+    std::ofstream file(options.benchmarkPath);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << options.benchmarkPath << " for writing" << std::endl;
+        return;
+    }
+
+    // GPU times arrive GpuProfiler::FRAME_LATENCY frames late, so each row holds
+    // the latest GPU total available when that frame finished
+    file << "frame,path_time_s,frame_ms,gpu_ms\n";
+    std::vector<float> frameTimes;
+    for (size_t i = 0; i < benchmarkFrames.size(); i++) {
+        const BenchmarkFrame& sample = benchmarkFrames[i];
+        file << i << ',' << sample.pathTime << ',' << sample.frameMilliseconds << ','
+             << sample.gpuMilliseconds << '\n';
+        frameTimes.push_back(sample.frameMilliseconds);
+    }
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    float total = 0.0f;
+    for (float frameTime : frameTimes) {
+        total += frameTime;
+    }
+    auto percentile = [&](float p) { return frameTimes[(size_t)(p * (frameTimes.size() - 1))]; };
+    std::cout << "Benchmark: " << frameTimes.size() << " frames, average " << total / frameTimes.size()
+              << " ms, median " << percentile(0.5f) << " ms, 95th " << percentile(0.95f)
+              << " ms, 99th " << percentile(0.99f) << " ms, written to " << options.benchmarkPath << std::endl;
+}
+
 bool Engine::initOpenGLWindow() {
     if (!glfwInit()) {
         fprintf(stderr, "ERROR: could not start GLFW3\n");
@@ -68,6 +231,9 @@ bool Engine::initOpenGLWindow() {
     glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
     glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    if (options.headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     glWindow = glfwCreateWindow(glWindowWidth, glWindowHeight, "OpenGL Shader Example", NULL, NULL);
     if (!glWindow) {
@@ -77,7 +243,7 @@ bool Engine::initOpenGLWindow() {
     }
 
     glfwMakeContextCurrent(glWindow);
-    glfwSwapInterval(1);
+    glfwSwapInterval(options.headless ? 0 : 1);
 
 #if not defined (__APPLE__)
     glewExperimental = GL_TRUE;
@@ -109,6 +275,9 @@ void Engine::initOpenGLState() {
 
     if (!audioManager.initialize()) {
         std::cerr << "Failed to initialize audio manager" << std::endl;
+    } else if (!audioManager.loadSoundBank("sounds/sounds.bank")) {
+        // sounds then load one file at a time
+        std::cout << "No sound bank, decoding sound files at startup" << std::endl;
     }
 }
 
@@ -132,54 +301,140 @@ void Engine::initObjects() {
     ground.LoadModel("objects/world/world3.obj");
     lightCube.LoadModel("objects/cube/cube.obj");
     screenQuad.LoadModel("objects/quad/quad.obj");
+
+    // same transform drawObjects uses for the ground
+    groundHeightfield.bake(ground, glm::scale(glm::mat4(1.0f), glm::vec3(GROUND_SCALE)));
 }
 
 void Engine::initShaders() {
-    myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag");
-    myCustomShader.useShaderProgram();
-    lightShader.loadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
+    // submit every program before checking any of them, so the driver can
+    // compile and link them concurrently instead of one round trip at a time
+    gps::Shader::enableParallelCompile();
+
+    sceneShaders.setSources("shaders/shaderStart.vert", "shaders/shaderStart.frag");
+    sceneShaders.prepare(getSceneVariantFeatures());
+    lightShader.beginLoadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
+    screenQuadShader.beginLoadShader("shaders/screenQuad.vert", "shaders/screenQuad.frag");
+    depthMapShader.beginLoadShader("shaders/depthMap.vert", "shaders/depthMap.frag");
+    rainShader.beginLoadShader("shaders/rain.vert", "shaders/rain.frag");
+    rainUpdateShader.beginLoadFeedbackShader("shaders/rainUpdate.vert",
+                                             {"outPosition", "outSize", "outVelocity", "outLifetime"});
+    splashShader.beginLoadShader("shaders/splash.vert", "shaders/splash.frag");
+    rainCullShader.beginLoadFeedbackShader("shaders/rainCull.vert", "shaders/rainCull.geom",
+                                           {"outPosition", "outSize"});
+
+    for (gps::Shader* shader : getShaders()) {
+        shader->finishLoad();
+        shaderWatcher.watch(shader);
+    }
+    shaderWatcher.start();
+
+    // a variant first built mid-frame missed this frame's forEach and the loop above
+    sceneShaders.setBuildCallback([this](gps::Shader& shader) {
+        setSceneUniforms(shader);
+        shaderWatcher.watch(&shader);
+    });
+}
+
+std::vector<gps::Shader*> Engine::getShaders() {
+    std::vector<gps::Shader*> shaders = sceneShaders.getShaders();
+    shaders.insert(shaders.end(), { &lightShader, &screenQuadShader, &depthMapShader,
+                                    &rainShader, &rainUpdateShader, &splashShader, &rainCullShader });
+    return shaders;
+}
+
+std::vector<unsigned> Engine::getSceneVariantFeatures() const {
+    // every material in the scene, lit with and without shadows (see getPokemonFeatures)
+    std::vector<const gps::Model3D*> models = { &ground };
+    for (auto pokemon : pokemons) {
+        models.push_back(&pokemon->getModel());
+    }
+
+    std::vector<unsigned> featureSets;
+    for (const gps::Model3D* sceneModel : models) {
+        for (const gps::Mesh& mesh : sceneModel->getMeshes()) {
+            for (unsigned scene : { SCENE_FEATURES, SCENE_FEATURES & ~gps::ShaderVariants::SHADOWS }) {
+                featureSets.push_back(scene | mesh.getMaterialFeatures());
+            }
+        }
+    }
+    return featureSets;
+}
+
+unsigned Engine::getPokemonFeatures(const Pokemon& pokemon) const {
+    // past the last cascade nothing can shadow it, so skip the shadow lookups entirely
+    glm::vec3 center;
+    float radius;
+    pokemon.getBoundingSphere(center, radius);
+    float viewDepth = -(view * glm::vec4(center, 1.0f)).z;
+    if (viewDepth - radius > cascadeSplits[shadowCascadeCount - 1]) {
+        return SCENE_FEATURES & ~gps::ShaderVariants::SHADOWS;
+    }
+    return SCENE_FEATURES;
+}
+
+void Engine::updateAudio() {
+    audioManager.setListener(camera->getCameraPosition(), camera->getCameraFrontDirection(),
+                             camera->getCameraUpDirection());
+    for (auto pokemon : pokemons) {
+        pokemon->updateSounds(audioManager);
+    }
+    audioManager.update();
+}
+
+void Engine::reloadChangedShaders() {
+    // a change arriving mid-compile simply restarts that shader's rebuild
+    std::vector<gps::Shader*> changed = shaderWatcher.takeChangedShaders();
+    for (gps::Shader* shader : changed) {
+        shader->beginReload();
+    }
+    // the rebuilt sources may include different files now
+    if (!changed.empty()) {
+        shaderWatcher.refreshFiles();
+    }
+
+    bool swapped = false;
+    for (gps::Shader* shader : getShaders()) {
+        if (!shader->hasPendingLoad() || !shader->isLoadComplete()) {
+            continue;
+        }
+        if (shader->finishLoad()) {
+            std::cout << "Reloaded shader " << shader->getSourceFiles().front() << std::endl;
+            swapped = true;
+        } else {
+            std::cerr << "Keeping the previous program for " << shader->getSourceFiles().front() << std::endl;
+        }
+    }
+    if (swapped) {
+        refreshUniforms();
+    }
+}
+
+void Engine::refreshUniforms() {
+    // a new program starts with default uniform values, restore the ones that are only
+    // set once; the scene variants get all of theirs every frame in scenePass
     lightShader.useShaderProgram();
-    screenQuadShader.loadShader("shaders/screenQuad.vert", "shaders/screenQuad.frag");
-    screenQuadShader.useShaderProgram();
-    depthMapShader.loadShader("shaders/depthMap.vert", "shaders/depthMap.frag");
-    depthMapShader.useShaderProgram();
-    rainShader.loadShader("shaders/rain.vert", "shaders/rain.frag");
-    rainShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 
+                      1, GL_FALSE, glm::value_ptr(camera->getProjectionMatrix()));
 }
 
 void Engine::initUniforms() {
-    myCustomShader.useShaderProgram();
-
+    // the scene variants receive these in scenePass
     model = glm::mat4(1.0f);
-    modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
     view = camera->getViewMatrix();
-    viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
     normalMatrix = calculateNormalMatrix(view * model);
-    normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
     projection = glm::perspective(glm::radians(45.0f),
                                 (float)retina_width / (float)retina_height,
                                 0.1f, 1000.0f);
-    projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
     //set the light direction
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
     lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), 
                                glm::vec3(0.0f, 1.0f, 0.0f));
-    lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");
-    glm::mat3 normalMatrixLight = calculateNormalMatrix(view * lightRotation);
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(normalMatrixLight * lightDir));
 
     //set light color
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-    lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
     lightShader.useShaderProgram();
     glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 
@@ -187,170 +442,375 @@ void Engine::initUniforms() {
 }
 
 void Engine::initFBO() {
-    glGenFramebuffers(1, &shadowMapFBO);
-
-    glGenTextures(1, &depthMapTexture);
-    glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-                 SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    rainSystem = new Rain(100000);
+    // the shadow map textures themselves are owned by the frame graph
+    invalidateStaticShadows();
+
+    // the debug view needs raw depth values, so it samples without comparison
+    glGenSamplers(1, &depthDebugSampler);
+    glSamplerParameteri(depthDebugSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glSamplerParameteri(depthDebugSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(depthDebugSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // the volume follows the camera, so far fewer drops give the same density
+    rainSystem = new Rain(20000);
+    rainSystem->setUpdateShader(&rainUpdateShader);
+    rainSystem->setCullShader(&rainCullShader);
+    rainSystem->setHeightfield(&groundHeightfield);
+    rainSystem->setEmitImpacts(true);
+
+    splashSystem = new Splash(16384);
 }
 
-glm::mat4 Engine::computeLightSpaceTrMatrix() {
+void Engine::computeShadowCascades() {
     glm::mat4 lightRotationMatrix = glm::rotate(glm::mat4(1.0f), 
                                                glm::radians(controls->getLightAngle()), 
                                                glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::vec3 rotatedLightDir = glm::vec3(lightRotationMatrix * glm::vec4(lightDir, 0.0f));
+    glm::vec3 rotatedLightDir = glm::normalize(glm::vec3(lightRotationMatrix * glm::vec4(lightDir, 0.0f)));
+    glm::vec3 lightUp = std::abs(rotatedLightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                                            : glm::vec3(0.0f, 1.0f, 0.0f);
+    // light orientation only, the cascades are placed in this space
+    glm::mat4 lightBasis = glm::lookAt(glm::vec3(0.0f), -rotatedLightDir, lightUp);
+
+    const float nearPlane = 0.1f;
+    float aspect = (float)retina_width / (float)retina_height;
+    glm::mat4 cameraView = camera->getViewMatrix();
+    float splitNear = nearPlane;
+
+    for (int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+        // blend of logarithmic and uniform split distances
+        float fraction = (float)(cascade + 1) / (float)shadowCascadeCount;
+        float logSplit = nearPlane * std::pow(SHADOW_DISTANCE / nearPlane, fraction);
+        float uniformSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * fraction;
+        float splitFar = glm::mix(uniformSplit, logSplit, CASCADE_SPLIT_LAMBDA);
+
+        glm::mat4 inverseSlice = glm::inverse(
+            glm::perspective(glm::radians(camera->getFieldOfView()), aspect, splitNear, splitFar) * cameraView);
+
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 corner = inverseSlice * glm::vec4((i & 1) ? 1.0f : -1.0f,
+                                                        (i & 2) ? 1.0f : -1.0f,
+                                                        (i & 4) ? 1.0f : -1.0f, 1.0f);
+            corners[i] = glm::vec3(corner) / corner.w;
+            center += corners[i];
+        }
+        center /= 8.0f;
 
-    glm::mat4 lightView = glm::lookAt(rotatedLightDir * 5.0f, 
-                                     glm::vec3(0.0f), 
-                                     glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 20.0f);
-    
-    return lightProjection * lightView;
+        // a bounding sphere keeps the cascade size constant while the camera turns
+        float radius = 0.0f;
+        for (int i = 0; i < 8; i++) {
+            radius = std::max(radius, glm::length(corners[i] - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // The centre moves in whole snap steps of whole texels, so the matrix is
+        // bit-identical until the camera crosses a step: no shimmer, and the cached
+        // terrain layer stays valid. The extent grows to keep the slice covered.
+        float extent = radius * (1.0f + CASCADE_SNAP_FRACTION);
+        float texelSize = 2.0f * extent / shadowResolution;
+        float snapStep = texelSize * std::max(1.0f, std::floor(radius * CASCADE_SNAP_FRACTION / texelSize));
+        glm::vec3 lightCenter = glm::vec3(lightBasis * glm::vec4(center, 1.0f));
+        lightCenter = glm::round(lightCenter / snapStep) * snapStep;
+
+        // casters outside the slice but between it and the light still need to land in the map
+        float depthRange = 2.0f * extent + SHADOW_CASTER_MARGIN;
+        glm::mat4 lightView = glm::translate(glm::mat4(1.0f),
+            -glm::vec3(lightCenter.x, lightCenter.y, lightCenter.z + extent + SHADOW_CASTER_MARGIN)) * lightBasis;
+        glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, 0.0f, depthRange);
+
+        cascadeLightMatrices[cascade] = lightProjection * lightView;
+        cascadeSplits[cascade] = splitFar;
+        cascadeBias[cascade] = SHADOW_BIAS / depthRange;
+        splitNear = splitFar;
+    }
 }
 
-void Engine::drawObjects(gps::Shader shader, bool depthPass) {
+void Engine::setShadowCascades(int count, unsigned int resolution) {
+    shadowCascadeCount = glm::clamp(count, 1, MAX_SHADOW_CASCADES);
+    shadowResolution = resolution;
+}
+
+void Engine::setShadowFiltering(int gridSize, int poissonTaps, float radius) {
+    pcfGridSize = glm::max(gridSize, 1);
+    pcfPoissonTaps = glm::clamp(poissonTaps, 1, 16);
+    pcfRadius = radius;
+}
+
+void Engine::invalidateStaticShadows() {
+    for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; cascade++) {
+        staticShadowValid[cascade] = false;
+    }
+}
+
+void Engine::updatePokemons(float deltaTime) {
+    for (auto pokemon : pokemons) {
+        pokemon->update(deltaTime);
+    }
+}
+
+void Engine::drawPokemons(gps::Shader& shader) {
     shader.useShaderProgram();
     
-    float deltaTime = 1.0f/60.0f;
     for (auto pokemon : pokemons) {
-        pokemon->update(deltaTime);
         pokemon->draw(shader);
     }
-    
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.03f));
+}
+
+void Engine::drawGround(gps::Shader& shader) {
+    shader.useShaderProgram();
+
+    model = glm::scale(glm::mat4(1.0f), glm::vec3(GROUND_SCALE));
     glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 
                       1, GL_FALSE, glm::value_ptr(model));
-    glUniform1i(glGetUniformLocation(shader.shaderProgram, "isSkydome"), 1);
     ground.Draw(shader);
+}
 
-    if (!depthPass) {
-        normalMatrix = calculateNormalMatrix(view * model);
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+void Engine::drawObjects(gps::ShaderVariants& variants) {
+    for (auto pokemon : pokemons) {
+        pokemon->draw(variants, getPokemonFeatures(*pokemon));
     }
+
+    model = glm::scale(glm::mat4(1.0f), glm::vec3(GROUND_SCALE));
+    ground.Draw(variants, SCENE_FEATURES, model);
 }
 
-void Engine::renderScene() {
-    // depth maps creation pass
+void Engine::initFrameGraph() {
+    frameGraph.setProfiler(&gpuProfiler);
+
+    // static casters (terrain) are cached in a persistent array, moving ones are
+    // redrawn every frame into a transient one
+    FrameGraph::TextureDesc shadowDesc = { (GLsizei)shadowResolution, (GLsizei)shadowResolution,
+                                           shadowCascadeCount, GL_DEPTH_COMPONENT, true };
+    frameGraph.createTexture("staticShadowMap", shadowDesc, true);
+    frameGraph.createTexture("dynamicShadowMap", shadowDesc);
+    frameGraph.importBackbuffer("backbuffer", retina_width, retina_height);
+
+    for (int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+        frameGraph.addPass("staticShadow" + std::to_string(cascade), {},
+                           {{"staticShadowMap", cascade, true}}, [this, cascade]() { staticShadowPass(cascade); });
+        frameGraph.addPass("dynamicShadow" + std::to_string(cascade), {},
+                           {{"dynamicShadowMap", cascade, false}}, [this, cascade]() { dynamicShadowPass(cascade); });
+    }
+
+    // the shadow layers are only produced when a pass this frame samples them
+    frameGraph.addPass("scene", {"staticShadowMap", "dynamicShadowMap"}, {{"backbuffer", -1, false}},
+                       [this]() { scenePass(); });
+    frameGraph.addPass("lightCube", {}, {{"backbuffer", -1, false}}, [this]() { lightCubePass(); });
+    frameGraph.addPass("rain", {}, {{"backbuffer", -1, false}}, [this]() { rainPass(); });
+    frameGraph.addPass("depthDebug", {"staticShadowMap", "dynamicShadowMap"}, {{"backbuffer", -1, false}},
+                       [this]() { depthDebugPass(); });
+    frameGraph.addOutput("backbuffer");
+}
+
+bool Engine::areShadowReceiversVisible(const glm::mat4& viewProjection) const {
+    glm::vec3 groundMin = ground.getBoundsMin() * GROUND_SCALE;
+    glm::vec3 groundMax = ground.getBoundsMax() * GROUND_SCALE;
+    if (isSphereInFrustum(viewProjection, (groundMin + groundMax) * 0.5f,
+                          glm::length(groundMax - groundMin) * 0.5f)) {
+        return true;
+    }
+
+    for (auto pokemon : pokemons) {
+        glm::vec3 center;
+        float radius;
+        pokemon->getBoundingSphere(center, radius);
+        if (isSphereInFrustum(viewProjection, center, radius)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Engine::staticShadowPass(int cascade) {
+    // the graph has bound and cleared this cascade's layer
     depthMapShader.useShaderProgram();
     glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-                       1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    drawObjects(depthMapShader, true);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                       1, GL_FALSE, glm::value_ptr(cascadeLightMatrices[cascade]));
+    drawGround(depthMapShader);
+    staticShadowLightMatrices[cascade] = cascadeLightMatrices[cascade];
+    staticShadowValid[cascade] = true;
+}
 
-    // render depth map on screen
-    if (controls->isShowingDepthMap()) {
-        glViewport(0, 0, retina_width, retina_height);
-        glClear(GL_COLOR_BUFFER_BIT);
-        screenQuadShader.useShaderProgram();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
-        glDisable(GL_DEPTH_TEST);
-        screenQuad.Draw(screenQuadShader);
-        glEnable(GL_DEPTH_TEST);
-    } else {
-        // final scene rendering pass (with shadows)
-        glViewport(0, 0, retina_width, retina_height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        myCustomShader.useShaderProgram();
-
-        view = camera->getViewMatrix();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-        lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), 
-                                  glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniform3fv(lightDirLoc, 1, 
-                    glm::value_ptr(calculateNormalMatrix(view * lightRotation) * lightDir));
-
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
-
-        glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"),
-                          1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-
-        drawObjects(myCustomShader, false);
-
-        lightShader.useShaderProgram();
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 
-                          1, GL_FALSE, glm::value_ptr(view));
-
-        model = lightRotation;
-        model = glm::translate(model, 1.0f * lightDir + glm::vec3(10.0f, 20.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 
-                          1, GL_FALSE, glm::value_ptr(model));
-
-        lightCube.Draw(lightShader);
-
-        if (rainSystem->isEnabled()) {
-            static float lastFrame = 0.0f;
-            float currentFrame = glfwGetTime();
-            float deltaTime = currentFrame - lastFrame;
-            lastFrame = currentFrame;
-
-            rainSystem->update(deltaTime, controls->getWindDirection(), controls->getWindStrength());
-            rainSystem->updateBuffer();
-
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            glEnable(GL_PROGRAM_POINT_SIZE);
-
-            rainShader.useShaderProgram();
-            glUniformMatrix4fv(glGetUniformLocation(rainShader.shaderProgram, "view"), 
-                             1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-            glUniformMatrix4fv(glGetUniformLocation(rainShader.shaderProgram, "projection"), 
-                             1, GL_FALSE, glm::value_ptr(projection));
-            glUniform3fv(glGetUniformLocation(rainShader.shaderProgram, "windDirection"), 
-                        1, glm::value_ptr(controls->getWindDirection()));
-            glUniform1f(glGetUniformLocation(rainShader.shaderProgram, "windStrength"), 
-                       controls->getWindStrength());
-
-            rainSystem->render();
-
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
-            glDisable(GL_BLEND);
-            glDisable(GL_PROGRAM_POINT_SIZE);
-        }
+void Engine::dynamicShadowPass(int cascade) {
+    depthMapShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
+                       1, GL_FALSE, glm::value_ptr(cascadeLightMatrices[cascade]));
+    drawPokemons(depthMapShader);
+}
+
+void Engine::depthDebugPass() {
+    screenQuadShader.useShaderProgram();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, frameGraph.getTexture("staticShadowMap"));
+    glBindSampler(0, depthDebugSampler);
+    glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, frameGraph.getTexture("dynamicShadowMap"));
+    glBindSampler(1, depthDebugSampler);
+    glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "dynamicDepthMap"), 1);
+    glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "layer"),
+                controls->getDebugCascade() % shadowCascadeCount);
+    glDisable(GL_DEPTH_TEST);
+    screenQuad.Draw(screenQuadShader);
+    glEnable(GL_DEPTH_TEST);
+    glBindSampler(0, 0);
+    glBindSampler(1, 0);
+}
+
+void Engine::scenePass() {
+    // final scene rendering pass (with shadows)
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, frameGraph.getTexture("staticShadowMap"));
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, frameGraph.getTexture("dynamicShadowMap"));
+
+    // every variant may be picked below, so they all get the frame's uniforms
+    normalMatrix = calculateNormalMatrix(view * glm::scale(glm::mat4(1.0f), glm::vec3(GROUND_SCALE)));
+    sceneShaders.forEach([this](gps::Shader& shader) { setSceneUniforms(shader); });
+
+    drawObjects(sceneShaders);
+}
+
+void Engine::setSceneUniforms(gps::Shader& shader) {
+    // the ones a variant compiled out are simply not found
+    GLuint program = shader.shaderProgram;
+    glm::mat4 cameraProjection = camera->getProjectionMatrix();
+    glm::vec3 lightDirEye = calculateNormalMatrix(view * lightRotation) * lightDir;
+    int pcfMode = controls->getShadowFilterMode();
+
+    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(cameraProjection));
+    glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    glUniform3fv(glGetUniformLocation(program, "lightDir"), 1, glm::value_ptr(lightDirEye));
+    glUniform3fv(glGetUniformLocation(program, "lightColor"), 1, glm::value_ptr(lightColor));
+
+    glUniform1i(glGetUniformLocation(program, "shadowMap"), 3);
+    glUniform1i(glGetUniformLocation(program, "dynamicShadowMap"), 4);
+    glUniformMatrix4fv(glGetUniformLocation(program, "lightSpaceTrMatrices"),
+                      shadowCascadeCount, GL_FALSE, glm::value_ptr(cascadeLightMatrices[0]));
+    glUniform1fv(glGetUniformLocation(program, "cascadeSplits"), shadowCascadeCount, cascadeSplits);
+    glUniform1fv(glGetUniformLocation(program, "cascadeBias"), shadowCascadeCount, cascadeBias);
+    glUniform1i(glGetUniformLocation(program, "cascadeCount"), shadowCascadeCount);
+
+    glUniform1i(glGetUniformLocation(program, "pcfMode"), pcfMode);
+    glUniform1i(glGetUniformLocation(program, "pcfKernelSize"),
+               pcfMode == Controls::SHADOW_FILTER_GRID ? pcfGridSize : pcfPoissonTaps);
+    glUniform1f(glGetUniformLocation(program, "pcfRadius"), pcfRadius);
+}
+
+void Engine::lightCubePass() {
+    lightShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 
+                      1, GL_FALSE, glm::value_ptr(view));
+
+    model = lightRotation;
+    model = glm::translate(model, 1.0f * lightDir + glm::vec3(10.0f, 20.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 
+                      1, GL_FALSE, glm::value_ptr(model));
+
+    lightCube.Draw(lightShader);
+}
+
+void Engine::rainPass() {
+    float deltaTime = frameDeltaTime;
+
+    rainSystem->followCamera(camera->getCameraPosition(), camera->getCameraFrontDirection());
+    rainSystem->update(deltaTime, controls->getWindDirection(), controls->getWindStrength());
+    rainSystem->updateBuffer(projection * camera->getViewMatrix());
+
+    splashSystem->emit(rainSystem->getImpacts());
+    splashSystem->update(deltaTime);
+    splashSystem->updateBuffer();
+
+    // depth tested but not written, so drops behind the terrain are rejected early
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    rainShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(rainShader.shaderProgram, "view"), 
+                     1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
+    glUniformMatrix4fv(glGetUniformLocation(rainShader.shaderProgram, "projection"), 
+                     1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(glGetUniformLocation(rainShader.shaderProgram, "windDirection"), 
+                1, glm::value_ptr(controls->getWindDirection()));
+    glUniform1f(glGetUniformLocation(rainShader.shaderProgram, "windStrength"), 
+               controls->getWindStrength());
+
+    rainSystem->render();
+
+    splashShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(splashShader.shaderProgram, "view"), 
+                     1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
+    glUniformMatrix4fv(glGetUniformLocation(splashShader.shaderProgram, "projection"), 
+                     1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(splashShader.shaderProgram, "time"), splashSystem->getTime());
+    glUniform1f(glGetUniformLocation(splashShader.shaderProgram, "lifetime"), splashSystem->getLifetime());
+    glUniform1i(glGetUniformLocation(splashShader.shaderProgram, "dropsPerSplash"), 
+               splashSystem->getDropsPerSplash());
+
+    splashSystem->render();
+
+    glDepthMask(GL_TRUE);
+    glEnable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
+
+void Engine::renderScene() {
+    TRACE_ZONE("Engine::renderScene");
+    // the Pokemon used to be stepped by 1/60 in both the shadow and the color pass,
+    // step them once per frame at that combined pace now that they are drawn per cascade
+    updatePokemons(2.0f / 60.0f);
+
+    computeShadowCascades();
+    view = camera->getViewMatrix();
+    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), 
+                              glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // the debug view only consumes the shadow maps, and the shadow maps are only
+    // consumed by the scene when something that receives shadows is on screen
+    bool showingDepthMap = controls->isShowingDepthMap();
+    for (int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+        // the terrain never moves, so its layer is only redrawn when the cascade does
+        bool staticDirty = !staticShadowValid[cascade] ||
+                           cascadeLightMatrices[cascade] != staticShadowLightMatrices[cascade];
+        frameGraph.setPassActive("staticShadow" + std::to_string(cascade), staticDirty);
     }
+    frameGraph.setPassActive("depthDebug", showingDepthMap);
+    frameGraph.setPassActive("scene", !showingDepthMap && areShadowReceiversVisible(projection * view));
+    frameGraph.setPassActive("lightCube", !showingDepthMap);
+    frameGraph.setPassActive("rain", !showingDepthMap && rainSystem->isEnabled());
+    gpuProfiler.beginFrame();
+    frameGraph.execute();
 }
 
 void Engine::cleanup() {
+    frameGraph.printTimings();
+#ifdef ENABLE_TRACING
+    TraceProfiler::writeChromeTrace("trace.json");
+#endif
+
     for (auto pokemon : pokemons) {
         delete pokemon;
     }
     pokemons.clear();
     
+    inputRecorder.stopRecording();
+    shaderWatcher.stop();
     delete camera;
     delete controls;
     delete rainSystem;
+    delete splashSystem;
     
-    glDeleteTextures(1, &depthMapTexture);
+    glDeleteSamplers(1, &depthDebugSampler);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &shadowMapFBO);
+    frameGraph.release();
+    gpuProfiler.release();
     
     audioManager.cleanup();
     glfwDestroyWindow(glWindow);
@@ -3,13 +3,31 @@
 
 #include <GLFW/glfw3.h>
 #include "../camera/Camera.hpp"
+#include "../camera/CameraPath.hpp"
 #include "../graphics/effects/Rain.hpp"
+#include "../graphics/effects/Splash.hpp"
 #include "../audio/AudioManager.hpp"
 #include "../entities/Pokemon.hpp"
 #include "../input/Controls.hpp"
+#include "../input/InputRecorder.hpp"
 #include "../graphics/shaders/Shader.hpp"
+#include "../graphics/shaders/ShaderVariants.hpp"
+#include "../graphics/shaders/ShaderWatcher.hpp"
+#include "../graphics/models/Heightfield.hpp"
+#include "FrameGraph.hpp"
+#include <string>
 #include <vector>
 
+// command line settings, see main.cpp
+struct EngineOptions {
+    std::string recordPath;     // record live input to this file
+    std::string replayPath;     // drive the run from a recording instead of live input
+    bool headless = false;      // hidden window and no vsync, for benchmark runs
+    float fixedTimestep = 0.0f; // seconds per frame, 0 follows the wall clock
+    std::string cameraPathFile = "paths/flythrough.path";
+    std::string benchmarkPath;  // fly the camera path once and write per-frame timings here
+};
+
 class Engine {
 public:
     Engine();
@@ -18,6 +36,17 @@ public:
     bool init();
     void run();
     void cleanup();
+
+    // forces the cached terrain shadows to be redrawn, e.g. after the static world changed
+    void invalidateStaticShadows();
+    // cascade count (up to MAX_SHADOW_CASCADES) and per-cascade resolution, call before init()
+    void setShadowCascades(int count, unsigned int resolution);
+    // PCF kernel: taps per side of the grid, taps of the rotated Poisson disk (max 16), radius in texels
+    void setShadowFiltering(int gridSize, int poissonTaps, float radius);
+    // call before init()
+    void setOptions(const EngineOptions& options) { this->options = options; }
+
+    static const int MAX_SHADOW_CASCADES = 4;
     
 private:
     bool initOpenGLWindow();
@@ -25,8 +54,27 @@ private:
     void initObjects();
     void initShaders();
     void initUniforms();
+    // swaps in shaders whose sources changed on disk once they linked
+    void reloadChangedShaders();
+    void refreshUniforms();
+    // moves the listener to the camera and the Pokemon voices to their owners
+    void updateAudio();
+    std::vector<gps::Shader*> getShaders();
+    std::vector<unsigned> getSceneVariantFeatures() const;
+    unsigned getPokemonFeatures(const Pokemon& pokemon) const;
     void initFBO();
+    void initFrameGraph();
     void renderScene();
+
+    // frame graph passes, see initFrameGraph for what each reads and writes
+    void staticShadowPass(int cascade);
+    void dynamicShadowPass(int cascade);
+    void depthDebugPass();
+    void scenePass();
+    void setSceneUniforms(gps::Shader& shader);
+    void lightCubePass();
+    void rainPass();
+    bool areShadowReceiversVisible(const glm::mat4& viewProjection) const;
     
     // Window properties
     GLFWwindow* glWindow;
@@ -38,47 +86,88 @@ private:
     gps::Camera* camera;
     Controls* controls;
     Rain* rainSystem;
+    Splash* splashSystem;
     AudioManager audioManager;
+    InputRecorder inputRecorder;
+    EngineOptions options;
+    float frameDeltaTime;
+    const unsigned int REPLAY_RANDOM_SEED = 1234;
+    gps::CameraPath cameraPath;
+
+    // benchmark runs keep the weather fixed so runs stay comparable
+    struct BenchmarkFrame {
+        float pathTime;
+        float frameMilliseconds;
+        float gpuMilliseconds;
+    };
+    std::vector<BenchmarkFrame> benchmarkFrames;
+    const float BENCHMARK_WIND_ANGLE = 90.0f;
+    const float BENCHMARK_WIND_STRENGTH = 5.0f;
+    void startBenchmark();
+    void finishBenchmark();
     std::vector<Pokemon*> pokemons;
+    FrameGraph frameGraph;
+    GpuProfiler gpuProfiler;
+    double lastTitleUpdate;
     
-    // Shaders
-    gps::Shader myCustomShader;
+    // Shaders, the scene one is compiled per feature set
+    gps::ShaderVariants sceneShaders;
     gps::Shader lightShader;
     gps::Shader screenQuadShader;
     gps::Shader depthMapShader;
     gps::Shader rainShader;
+    gps::Shader rainUpdateShader;
+    gps::Shader rainCullShader;
+    gps::Shader splashShader;
+    gps::ShaderWatcher shaderWatcher;
     
     // Models
     gps::Model3D ground;
     gps::Model3D lightCube;
     gps::Model3D screenQuad;
+    gps::Heightfield groundHeightfield;
+    const float GROUND_SCALE = 0.03f;
     
     // Matrices and uniforms
     glm::mat4 model;
-    GLuint modelLoc;
     glm::mat4 view;
-    GLuint viewLoc;
     glm::mat4 projection;
-    GLuint projectionLoc;
     glm::mat3 normalMatrix;
-    GLuint normalMatrixLoc;
     glm::mat4 lightRotation;
+    // ShaderVariants features of a regular scene mesh before its material is added
+    const unsigned SCENE_FEATURES = gps::ShaderVariants::SHADOWS | gps::ShaderVariants::FOG;
     
     // Lighting
     glm::vec3 lightDir;
-    GLuint lightDirLoc;
     glm::vec3 lightColor;
-    GLuint lightColorLoc;
     GLfloat lightAngle;
     
-    // Shadow mapping
-    GLuint shadowMapFBO;
-    GLuint depthMapTexture;
-    const unsigned int SHADOW_WIDTH = 2048;
-    const unsigned int SHADOW_HEIGHT = 2048;
+    // Cascaded shadow mapping, one texture array layer per cascade, each split
+    // into a cached static layer and a per-frame dynamic one (both frame graph textures)
+    int shadowCascadeCount;
+    unsigned int shadowResolution;
+    glm::mat4 cascadeLightMatrices[MAX_SHADOW_CASCADES];
+    float cascadeSplits[MAX_SHADOW_CASCADES];
+    float cascadeBias[MAX_SHADOW_CASCADES];
+    glm::mat4 staticShadowLightMatrices[MAX_SHADOW_CASCADES];
+    bool staticShadowValid[MAX_SHADOW_CASCADES];
+    GLuint depthDebugSampler;
+    int pcfGridSize;
+    int pcfPoissonTaps;
+    float pcfRadius;
+    const float SHADOW_DISTANCE = 150.0f;
+    const float CASCADE_SPLIT_LAMBDA = 0.75f;
+    const float SHADOW_CASTER_MARGIN = 100.0f;
+    // cascades move in steps of this fraction of their radius, so the cached
+    // terrain layer survives small camera moves; costs as much resolution
+    const float CASCADE_SNAP_FRACTION = 0.25f;
+    const float SHADOW_BIAS = 0.1f;
     
-    glm::mat4 computeLightSpaceTrMatrix();
-    void drawObjects(gps::Shader shader, bool depthPass);
+    void computeShadowCascades();
+    void updatePokemons(float deltaTime);
+    void drawObjects(gps::ShaderVariants& variants);
+    void drawPokemons(gps::Shader& shader);
+    void drawGround(gps::Shader& shader);
 };
 
 #endif /* Engine_hpp */ 
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include "FrameGraph.hpp"
+#include "TraceProfiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <unordered_set>
+
+static bool isDepthFormat(GLenum internalFormat) {
+    return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT16 ||
+           internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F;
+}
+
+void FrameGraph::createTexture(const std::string& name, const TextureDesc& desc, bool persistent) {
+    if (persistent) {
+        resources[name] = { ResourceKind::Persistent, desc, createPhysicalTexture(desc) };
+    } else {
+        resources[name] = { ResourceKind::Transient, desc, 0 };
+    }
+    compiled = false;
+}
+
+void FrameGraph::importBackbuffer(const std::string& name, GLsizei width, GLsizei height) {
+    resources[name] = { ResourceKind::Backbuffer, { width, height, 0, GL_RGBA8, false }, 0 };
+    compiled = false;
+}
+
+void FrameGraph::addPass(const std::string& name,
+                         const std::vector<std::string>& reads,
+                         const std::vector<Attachment>& attachments,
+                         std::function<void()> execute) {
+    Pass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.attachments = attachments;
+    pass.execute = execute;
+    pass.active = true;
+    pass.executed = false;
+    pass.cpuMilliseconds = 0.0;
+    pass.averageMilliseconds = 0.0;
+    pass.executions = 0;
+    passes.push_back(pass);
+    compiled = false;
+}
+
+void FrameGraph::addOutput(const std::string& resource) {
+    outputs.push_back(resource);
+}
+
+void FrameGraph::setPassActive(const std::string& name, bool active) {
+    Pass* pass = findPass(name);
+    if (pass) {
+        pass->active = active;
+    } else {
+        std::cerr << "Frame graph has no pass named " << name << std::endl;
+    }
+}
+
+FrameGraph::Pass* FrameGraph::findPass(const std::string& name) {
+    for (Pass& pass : passes) {
+        if (pass.name == name) {
+            return &pass;
+        }
+    }
+    return nullptr;
+}
+
+GLuint FrameGraph::getTexture(const std::string& name) const {
+    auto it = resources.find(name);
+    return it == resources.end() ? 0 : it->second.texture;
+}
+
+void FrameGraph::compile() {
+    // writers of a resource keep their declaration order (blending passes stack
+    // up in the order they were added), pure readers wait for every writer
+    int passCount = (int)passes.size();
+    std::vector<std::set<int>> dependents(passCount);
+    std::vector<int> dependencyCount(passCount, 0);
+    auto addEdge = [&](int from, int to) {
+        if (from != to && dependents[from].insert(to).second) {
+            dependencyCount[to]++;
+        }
+    };
+
+    std::map<std::string, std::vector<int>> writers;
+    for (int i = 0; i < passCount; i++) {
+        for (const Attachment& attachment : passes[i].attachments) {
+            std::vector<int>& resourceWriters = writers[attachment.resource];
+            if (resourceWriters.empty() || resourceWriters.back() != i) {
+                resourceWriters.push_back(i);
+            }
+        }
+    }
+    for (auto& [resource, resourceWriters] : writers) {
+        for (size_t k = 1; k < resourceWriters.size(); k++) {
+            addEdge(resourceWriters[k - 1], resourceWriters[k]);
+        }
+    }
+    for (int i = 0; i < passCount; i++) {
+        for (const std::string& resource : passes[i].reads) {
+            auto it = writers.find(resource);
+            if (it == writers.end()) {
+                continue;
+            }
+            bool alsoWrites = std::find(it->second.begin(), it->second.end(), i) != it->second.end();
+            if (!alsoWrites) {
+                for (int writer : it->second) {
+                    addEdge(writer, i);
+                }
+            }
+        }
+    }
+
+    // Kahn's algorithm, ties broken by declaration order
+    order.clear();
+    std::set<int> ready;
+    for (int i = 0; i < passCount; i++) {
+        if (dependencyCount[i] == 0) {
+            ready.insert(i);
+        }
+    }
+    while (!ready.empty()) {
+        int pass = *ready.begin();
+        ready.erase(ready.begin());
+        order.push_back(pass);
+        for (int dependent : dependents[pass]) {
+            if (--dependencyCount[dependent] == 0) {
+                ready.insert(dependent);
+            }
+        }
+    }
+
+    if ((int)order.size() != passCount) {
+        std::cerr << "Frame graph has a dependency cycle, falling back to declaration order" << std::endl;
+        order.clear();
+        for (int i = 0; i < passCount; i++) {
+            order.push_back(i);
+        }
+    }
+    compiled = true;
+}
+
+GLuint FrameGraph::createPhysicalTexture(const TextureDesc& desc) {
+    GLenum target = desc.layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    bool depth = isDepthFormat(desc.internalFormat);
+    GLenum format = depth ? GL_DEPTH_COMPONENT : GL_RGBA;
+    GLenum type = depth ? GL_FLOAT : GL_UNSIGNED_BYTE;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (desc.layers > 0) {
+        glTexImage3D(target, 0, desc.internalFormat, desc.width, desc.height, desc.layers, 0, format, type, NULL);
+    } else {
+        glTexImage2D(target, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+    }
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (desc.depthCompare) {
+        // outside the map counts as lit
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    } else {
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(target, 0);
+    return texture;
+}
+
+void FrameGraph::allocateTransients(const std::vector<int>& executedOrder) {
+    // lifetime of every transient resource as positions in this frame's order
+    std::map<std::string, std::pair<int, int>> lifetimes;
+    for (int position = 0; position < (int)executedOrder.size(); position++) {
+        const Pass& pass = passes[executedOrder[position]];
+        auto touch = [&](const std::string& name) {
+            auto it = resources.find(name);
+            if (it == resources.end() || it->second.kind != ResourceKind::Transient) {
+                return;
+            }
+            auto lifetime = lifetimes.find(name);
+            if (lifetime == lifetimes.end()) {
+                lifetimes[name] = { position, position };
+            } else {
+                lifetime->second.second = position;
+            }
+        };
+        for (const Attachment& attachment : pass.attachments) {
+            touch(attachment.resource);
+        }
+        for (const std::string& read : pass.reads) {
+            touch(read);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::pair<int, int>>> sorted(lifetimes.begin(), lifetimes.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.second.first < b.second.first; });
+
+    for (PhysicalTexture& physical : physicalTextures) {
+        physical.busyUntil = -1;
+    }
+
+    // reuse a texture of the same shape once its previous user is done with it
+    for (auto& [name, lifetime] : sorted) {
+        Resource& resource = resources[name];
+        PhysicalTexture* match = nullptr;
+        for (PhysicalTexture& physical : physicalTextures) {
+            if (physical.desc == resource.desc && physical.busyUntil < lifetime.first) {
+                match = &physical;
+                break;
+            }
+        }
+        if (!match) {
+            physicalTextures.push_back({ resource.desc, createPhysicalTexture(resource.desc), -1 });
+            match = &physicalTextures.back();
+        }
+        match->busyUntil = lifetime.second;
+        resource.texture = match->texture;
+    }
+}
+
+void FrameGraph::bindAttachments(const Pass& pass, std::vector<std::pair<std::string, int>>& clearedTargets) {
+    if (pass.attachments.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<GLuint, int>> key;
+    GLsizei width = 0;
+    GLsizei height = 0;
+    bool backbuffer = false;
+    for (const Attachment& attachment : pass.attachments) {
+        const Resource& resource = resources[attachment.resource];
+        backbuffer = backbuffer || resource.kind == ResourceKind::Backbuffer;
+        key.push_back({ resource.texture, attachment.layer });
+        width = resource.desc.width;
+        height = resource.desc.height;
+    }
+
+    if (backbuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    } else {
+        auto it = framebuffers.find(key);
+        if (it != framebuffers.end()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, it->second);
+        } else {
+            GLuint fbo;
+            glGenFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+            std::vector<GLenum> drawBuffers;
+            for (const Attachment& attachment : pass.attachments) {
+                const Resource& resource = resources[attachment.resource];
+                GLenum point = GL_DEPTH_ATTACHMENT;
+                if (!isDepthFormat(resource.desc.internalFormat)) {
+                    point = GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+                    drawBuffers.push_back(point);
+                }
+                if (attachment.layer >= 0) {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, point, resource.texture, 0, attachment.layer);
+                } else {
+                    glFramebufferTexture(GL_FRAMEBUFFER, point, resource.texture, 0);
+                }
+            }
+            if (drawBuffers.empty()) {
+                glDrawBuffer(GL_NONE);
+                glReadBuffer(GL_NONE);
+            } else {
+                glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+            }
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Frame graph framebuffer for pass " << pass.name << " is incomplete" << std::endl;
+            }
+            framebuffers[key] = fbo;
+        }
+    }
+    glViewport(0, 0, width, height);
+
+    // a target is cleared right before the first pass that writes it this frame,
+    // persistent textures keep their contents unless the attachment asks otherwise
+    GLbitfield clearMask = 0;
+    for (const Attachment& attachment : pass.attachments) {
+        const Resource& resource = resources[attachment.resource];
+        std::pair<std::string, int> target(attachment.resource, attachment.layer);
+        bool firstWrite = std::find(clearedTargets.begin(), clearedTargets.end(), target) == clearedTargets.end();
+        bool autoClear = resource.kind != ResourceKind::Persistent && firstWrite;
+        if (!autoClear && !attachment.clear) {
+            continue;
+        }
+        clearedTargets.push_back(target);
+        if (resource.kind == ResourceKind::Backbuffer) {
+            clearMask |= GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
+        } else if (isDepthFormat(resource.desc.internalFormat)) {
+            clearMask |= GL_DEPTH_BUFFER_BIT;
+        } else {
+            clearMask |= GL_COLOR_BUFFER_BIT;
+        }
+    }
+    if (clearMask) {
+        glClear(clearMask);
+    }
+}
+
+void FrameGraph::execute() {
+    if (!compiled) {
+        compile();
+    }
+
+    // walk backwards from the outputs, a pass is needed when a later needed
+    // pass (or the frame itself) consumes something it writes
+    std::unordered_set<std::string> consumed(outputs.begin(), outputs.end());
+    std::vector<bool> needed(passes.size(), false);
+    for (int position = (int)order.size() - 1; position >= 0; position--) {
+        int i = order[position];
+        const Pass& pass = passes[i];
+        if (!pass.active) {
+            continue;
+        }
+        needed[i] = std::any_of(pass.attachments.begin(), pass.attachments.end(),
+                                [&](const Attachment& attachment) { return consumed.count(attachment.resource) > 0; });
+        if (needed[i]) {
+            consumed.insert(pass.reads.begin(), pass.reads.end());
+        }
+    }
+
+    std::vector<int> executedOrder;
+    for (int i : order) {
+        passes[i].executed = needed[i];
+        if (needed[i]) {
+            executedOrder.push_back(i);
+        }
+    }
+    allocateTransients(executedOrder);
+
+    // render to texture followed by sampling is ordered by GL itself, so the
+    // only transitions left to place are framebuffer binds and clears
+    std::vector<std::pair<std::string, int>> clearedTargets;
+    for (int i : executedOrder) {
+        Pass& pass = passes[i];
+        TRACE_ZONE(pass.name.c_str());
+        auto start = std::chrono::steady_clock::now();
+        if (profiler) {
+            profiler->beginZone(pass.name);
+        }
+        bindAttachments(pass, clearedTargets);
+        pass.execute();
+        if (profiler) {
+            profiler->endZone();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        pass.cpuMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        pass.executions++;
+        pass.averageMilliseconds += (pass.cpuMilliseconds - pass.averageMilliseconds) / pass.executions;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FrameGraph::printTimings() const {
+    if (passes.empty()) {
+        return;
+    }
+    std::cout << "Frame graph CPU timings (average ms / runs), "
+              << physicalTextures.size() << " transient textures:" << std::endl;
+    for (int i : order) {
+        const Pass& pass = passes[i];
+        std::cout << "  " << std::left << std::setw(16) << pass.name
+                  << std::right << std::fixed << std::setprecision(3) << pass.averageMilliseconds
+                  << " / " << pass.executions << std::endl;
+    }
+}
+
+void FrameGraph::release() {
+    for (auto& [key, fbo] : framebuffers) {
+        glDeleteFramebuffers(1, &fbo);
+    }
+    framebuffers.clear();
+    for (PhysicalTexture& physical : physicalTextures) {
+        glDeleteTextures(1, &physical.texture);
+    }
+    physicalTextures.clear();
+    for (auto& [name, resource] : resources) {
+        if (resource.kind == ResourceKind::Persistent) {
+            glDeleteTextures(1, &resource.texture);
+        }
+        resource.texture = 0;
+    }
+}
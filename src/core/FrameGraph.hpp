@@ -0,0 +1,115 @@
+#ifndef FrameGraph_hpp
+#define FrameGraph_hpp
+
+#if defined (__APPLE__)
+    #define GLFW_INCLUDE_GLCOREARB
+#else
+    #include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+#include "GpuProfiler.hpp"
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Render graph for a frame. Passes declare the textures they render into
+// (attachments) and the ones they sample (reads) by name; the graph orders
+// them from those dependencies, skips passes whose results nobody consumes,
+// binds framebuffers and viewports, clears targets before their first write
+// and lets transient textures with disjoint lifetimes share memory.
+class FrameGraph {
+public:
+    struct TextureDesc {
+        GLsizei width;
+        GLsizei height;
+        GLsizei layers;         // 0 for a plain 2D texture, otherwise a 2D array
+        GLenum internalFormat;  // depth formats become depth attachments
+        bool depthCompare;      // sampled with a shadow sampler
+
+        bool operator==(const TextureDesc& other) const {
+            return width == other.width && height == other.height && layers == other.layers &&
+                   internalFormat == other.internalFormat && depthCompare == other.depthCompare;
+        }
+    };
+
+    struct Attachment {
+        std::string resource;
+        int layer;      // array layer to render into, -1 for the whole texture
+        bool clear;     // clear a persistent texture, the others are cleared on first write
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<std::string> reads;
+        std::vector<Attachment> attachments;
+        std::function<void()> execute;
+        bool active;               // toggled per frame by the owner
+        bool executed;             // ran during the last frame
+        double cpuMilliseconds;    // last execution
+        double averageMilliseconds;
+        long executions;
+    };
+
+    // transient textures only live within a frame and may alias each other,
+    // persistent ones keep their contents between frames
+    void createTexture(const std::string& name, const TextureDesc& desc, bool persistent = false);
+    // the default framebuffer, cleared before its first write every frame
+    void importBackbuffer(const std::string& name, GLsizei width, GLsizei height);
+
+    // passes may be added in any order, the graph sorts them by their dependencies
+    void addPass(const std::string& name,
+                 const std::vector<std::string>& reads,
+                 const std::vector<Attachment>& attachments,
+                 std::function<void()> execute);
+    // resources consumed outside the graph, e.g. the window backbuffer
+    void addOutput(const std::string& resource);
+
+    void setPassActive(const std::string& name, bool active);
+    // every executed pass becomes a profiler zone named after it
+    void setProfiler(GpuProfiler* profiler) { this->profiler = profiler; }
+    void execute();
+
+    // physical texture behind a resource for the current frame
+    GLuint getTexture(const std::string& name) const;
+    int getTransientTextureCount() const { return (int)physicalTextures.size(); }
+
+    const std::vector<Pass>& getPasses() const { return passes; }
+    void printTimings() const;
+    // deletes the textures and framebuffers the graph created, needs a current context
+    void release();
+
+private:
+    enum class ResourceKind { Transient, Persistent, Backbuffer };
+
+    struct Resource {
+        ResourceKind kind;
+        TextureDesc desc;
+        GLuint texture;     // current physical texture, 0 for the backbuffer
+    };
+
+    struct PhysicalTexture {
+        TextureDesc desc;
+        GLuint texture;
+        int busyUntil;      // last position in this frame's order that uses it
+    };
+
+    std::vector<Pass> passes;
+    std::vector<std::string> outputs;
+    std::map<std::string, Resource> resources;
+    std::vector<PhysicalTexture> physicalTextures;
+    std::map<std::vector<std::pair<GLuint, int>>, GLuint> framebuffers;
+    std::vector<int> order;     // pass indices in dependency order
+    bool compiled = false;
+    GpuProfiler* profiler = nullptr;
+
+    Pass* findPass(const std::string& name);
+    void compile();
+    void allocateTransients(const std::vector<int>& executedOrder);
+    GLuint createPhysicalTexture(const TextureDesc& desc);
+    void bindAttachments(const Pass& pass, std::vector<std::pair<std::string, int>>& clearedTargets);
+};
+
+#endif /* FrameGraph_hpp */
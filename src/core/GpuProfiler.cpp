@@ -0,0 +1,166 @@
+#include "GpuProfiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+int GpuProfiler::findZone(const std::string& name) {
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (stats[i].name == name) {
+            return (int)i;
+        }
+    }
+
+    Zone zone = {};
+    glGenQueries(FRAME_LATENCY, zone.queries);
+    zones.push_back(zone);
+    stats.push_back({ name, 0.0, 0.0, 0.0, 0.0, 0.0, 0 });
+    return (int)zones.size() - 1;
+}
+
+void GpuProfiler::beginFrame() {
+    frameIndex++;
+    frameSlot = frameIndex % FRAME_LATENCY;
+
+    // this slot was last written FRAME_LATENCY frames ago, its results are
+    // normally ready; if the GPU is that far behind the sample is dropped
+    for (size_t i = 0; i < zones.size(); i++) {
+        Zone& zone = zones[i];
+        if (!zone.pending[frameSlot]) {
+            continue;
+        }
+        zone.pending[frameSlot] = false;
+
+        GLint available = 0;
+        glGetQueryObjectiv(zone.queries[frameSlot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(zone.queries[frameSlot], GL_QUERY_RESULT, &elapsed);
+        recordSample((int)i, elapsed / 1.0e6);
+    }
+}
+
+void GpuProfiler::beginZone(const std::string& name) {
+    if (activeZone >= 0) {
+        std::cerr << "GpuProfiler zone " << name << " started inside " << stats[activeZone].name << std::endl;
+        return;
+    }
+    activeZone = findZone(name);
+    Zone& zone = zones[activeZone];
+    zone.cpuStart = glfwGetTime();
+    zone.lastFrame = frameIndex;
+    glBeginQuery(GL_TIME_ELAPSED, zone.queries[frameSlot]);
+}
+
+void GpuProfiler::endZone() {
+    if (activeZone < 0) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    Zone& zone = zones[activeZone];
+    zone.pending[frameSlot] = true;
+    zone.lastCpuMilliseconds = (glfwGetTime() - zone.cpuStart) * 1000.0;
+    activeZone = -1;
+}
+
+void GpuProfiler::recordSample(int index, double gpuMilliseconds) {
+    Zone& zone = zones[index];
+    zone.gpuHistory[zone.historyNext] = gpuMilliseconds;
+    // the CPU side is known immediately, pair it with the GPU sample as it arrives
+    zone.cpuHistory[zone.historyNext] = zone.lastCpuMilliseconds;
+    zone.historyNext = (zone.historyNext + 1) % WINDOW_SIZE;
+    zone.historyCount = std::min(zone.historyCount + 1, WINDOW_SIZE);
+
+    ZoneStats& zoneStats = stats[index];
+    zoneStats.lastGpuMilliseconds = gpuMilliseconds;
+    zoneStats.samples++;
+
+    double gpuSum = 0.0;
+    double cpuSum = 0.0;
+    zoneStats.minGpuMilliseconds = zone.gpuHistory[0];
+    zoneStats.maxGpuMilliseconds = zone.gpuHistory[0];
+    for (int i = 0; i < zone.historyCount; i++) {
+        gpuSum += zone.gpuHistory[i];
+        cpuSum += zone.cpuHistory[i];
+        zoneStats.minGpuMilliseconds = std::min(zoneStats.minGpuMilliseconds, zone.gpuHistory[i]);
+        zoneStats.maxGpuMilliseconds = std::max(zoneStats.maxGpuMilliseconds, zone.gpuHistory[i]);
+    }
+    zoneStats.averageGpuMilliseconds = gpuSum / zone.historyCount;
+    zoneStats.averageCpuMilliseconds = cpuSum / zone.historyCount;
+}
+
+bool GpuProfiler::isCurrent(int zone) const {
+    return frameIndex - zones[zone].lastFrame <= FRAME_LATENCY;
+}
+
+double GpuProfiler::getAverageGpuFrameMilliseconds() const {
+    double total = 0.0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (isCurrent((int)i)) {
+            total += stats[i].averageGpuMilliseconds;
+        }
+    }
+    return total;
+}
+
+double GpuProfiler::getLastGpuFrameMilliseconds() const {
+    double total = 0.0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (isCurrent((int)i)) {
+            total += stats[i].lastGpuMilliseconds;
+        }
+    }
+    return total;
+}
+
+double GpuProfiler::getAverageCpuFrameMilliseconds() const {
+    double total = 0.0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (isCurrent((int)i)) {
+            total += stats[i].averageCpuMilliseconds;
+        }
+    }
+    return total;
+}
+
+std::string GpuProfiler::getSummary() const {
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(2)
+            << "GPU " << getAverageGpuFrameMilliseconds() << " ms / CPU "
+            << getAverageCpuFrameMilliseconds() << " ms";
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (stats[i].samples > 0 && isCurrent((int)i)) {
+            summary << " | " << stats[i].name << " " << stats[i].averageGpuMilliseconds;
+        }
+    }
+    return summary.str();
+}
+
+bool GpuProfiler::writeCsv(const std::string& fileName) const {
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << fileName << " for writing" << std::endl;
+        return false;
+    }
+
+    file << "zone,samples,gpu_last_ms,gpu_avg_ms,gpu_min_ms,gpu_max_ms,cpu_avg_ms\n";
+    file << std::fixed << std::setprecision(4);
+    for (const ZoneStats& zoneStats : stats) {
+        file << zoneStats.name << ',' << zoneStats.samples << ','
+             << zoneStats.lastGpuMilliseconds << ',' << zoneStats.averageGpuMilliseconds << ','
+             << zoneStats.minGpuMilliseconds << ',' << zoneStats.maxGpuMilliseconds << ','
+             << zoneStats.averageCpuMilliseconds << '\n';
+    }
+    return true;
+}
+
+void GpuProfiler::release() {
+    for (Zone& zone : zones) {
+        glDeleteQueries(FRAME_LATENCY, zone.queries);
+    }
+    zones.clear();
+    stats.clear();
+}
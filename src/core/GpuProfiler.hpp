@@ -0,0 +1,71 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#if defined (__APPLE__)
+    #define GLFW_INCLUDE_GLCOREARB
+#else
+    #include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+#include <string>
+#include <vector>
+
+// Per-zone GPU (GL_TIME_ELAPSED) and CPU timings. Queries are kept in a ring
+// of frames and read back FRAME_LATENCY frames later, so reading the results
+// never waits for the GPU. Zones must not nest, the timer queries cannot.
+class GpuProfiler {
+public:
+    struct ZoneStats {
+        std::string name;
+        double lastGpuMilliseconds;
+        double averageGpuMilliseconds;  // over the rolling window
+        double minGpuMilliseconds;
+        double maxGpuMilliseconds;
+        double averageCpuMilliseconds;
+        long samples;
+    };
+
+    static constexpr int FRAME_LATENCY = 4;
+    static constexpr int WINDOW_SIZE = 120;
+
+    // collects the frame issued FRAME_LATENCY - 1 frames ago and reuses its queries
+    void beginFrame();
+    void beginZone(const std::string& name);
+    void endZone();
+
+    const std::vector<ZoneStats>& getStats() const { return stats; }
+    double getAverageGpuFrameMilliseconds() const;
+    double getAverageCpuFrameMilliseconds() const;
+    // sum of the newest sample of every zone still in use
+    double getLastGpuFrameMilliseconds() const;
+    // short per-zone report, e.g. for the window title
+    std::string getSummary() const;
+    bool writeCsv(const std::string& fileName) const;
+    void release();
+
+private:
+    struct Zone {
+        GLuint queries[FRAME_LATENCY];
+        bool pending[FRAME_LATENCY];
+        double gpuHistory[WINDOW_SIZE];
+        double cpuHistory[WINDOW_SIZE];
+        double cpuStart;
+        double lastCpuMilliseconds;
+        int historyCount;
+        int historyNext;
+        long lastFrame;     // zones of skipped passes drop out of the frame totals
+    };
+
+    std::vector<Zone> zones;
+    std::vector<ZoneStats> stats;
+    int frameSlot = 0;
+    long frameIndex = 0;
+    int activeZone = -1;
+
+    int findZone(const std::string& name);
+    bool isCurrent(int zone) const;
+    void recordSample(int zone, double gpuMilliseconds);
+};
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,111 @@
+#include "TraceProfiler.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// zone names are arbitrary strings, keep quotes and control characters from breaking the JSON
+static void writeJsonString(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        switch (*c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if ((unsigned char)*c < 0x20) {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)*c
+                        << std::dec << std::setfill(' ');
+                } else {
+                    out << *c;
+                }
+        }
+    }
+    out << '"';
+}
+
+std::vector<TraceProfiler::ThreadBuffer*>& TraceProfiler::getThreadBuffers() {
+    static std::vector<ThreadBuffer*> buffers;
+    return buffers;
+}
+
+std::mutex& TraceProfiler::getRegistryMutex() {
+    static std::mutex registryMutex;
+    return registryMutex;
+}
+
+uint64_t TraceProfiler::now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+TraceProfiler::ThreadBuffer* TraceProfiler::getThreadBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        buffer = new ThreadBuffer();
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        buffer->threadId = (uint32_t)getThreadBuffers().size() + 1;
+        getThreadBuffers().push_back(buffer);
+    }
+    return buffer;
+}
+
+void TraceProfiler::record(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds) {
+    // only the owning thread writes, the release store publishes the event to the exporter
+    ThreadBuffer* buffer = getThreadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % EVENTS_PER_THREAD] = { name, startNanoseconds, endNanoseconds };
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool TraceProfiler::writeChromeTrace(const std::string& fileName) {
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        buffers = getThreadBuffers();
+    }
+
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << fileName << " for writing" << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t written = 0;
+    for (ThreadBuffer* buffer : buffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+        std::vector<Event> events;
+        events.reserve(head - begin);
+        for (uint64_t i = begin; i < head; i++) {
+            events.push_back(buffer->events[i % EVENTS_PER_THREAD]);
+        }
+
+        // the owner keeps recording while we copy, drop whatever it may have overwritten;
+        // it may also be halfway through writing event headAfter, which shares a slot
+        // with headAfter - EVENTS_PER_THREAD
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t headAfter = buffer->head.load(std::memory_order_relaxed);
+        uint64_t firstIntact = headAfter + 1 > EVENTS_PER_THREAD ? headAfter + 1 - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            if (i < firstIntact) {
+                continue;
+            }
+            const Event& event = events[i - begin];
+            file << (first ? "" : ",\n") << "{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << event.startNanoseconds / 1000.0
+                 << ",\"dur\":" << (event.endNanoseconds - event.startNanoseconds) / 1000.0 << "}";
+            first = false;
+            written++;
+        }
+    }
+    file << "\n]}\n";
+
+    std::cout << "Wrote " << written << " trace events to " << fileName << std::endl;
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef TraceProfiler_hpp
+#define TraceProfiler_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CPU zone profiler. TRACE_ZONE("name") times the enclosing scope into a ring
+// buffer owned by the calling thread (no locks on the recording path), and
+// TraceProfiler::writeChromeTrace dumps the recorded zones as Chrome trace JSON
+// for chrome://tracing or Perfetto. Zones are only compiled in when the
+// ENABLE_TRACING option is set, otherwise the macro expands to nothing.
+// Zone names must be string literals or otherwise outlive the export.
+class TraceProfiler {
+public:
+    struct Event {
+        const char* name;
+        uint64_t startNanoseconds;
+        uint64_t endNanoseconds;
+    };
+
+    static const uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+    static uint64_t now();
+    static void record(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds);
+    // writes the events still held by every thread's ring
+    static bool writeChromeTrace(const std::string& fileName);
+
+private:
+    struct ThreadBuffer {
+        Event events[EVENTS_PER_THREAD];
+        std::atomic<uint64_t> head{0};   // total events ever written by the owner thread
+        uint32_t threadId;
+    };
+
+    static ThreadBuffer* getThreadBuffer();
+    // buffers are registered once per thread and never freed, so a thread that
+    // exits still shows up in the export
+    static std::vector<ThreadBuffer*>& getThreadBuffers();
+    static std::mutex& getRegistryMutex();
+};
+
+class TraceZone {
+public:
+    explicit TraceZone(const char* name) : name(name), start(TraceProfiler::now()) {}
+    ~TraceZone() { TraceProfiler::record(name, start, TraceProfiler::now()); }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_TRACING
+    #define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+    #define TRACE_ZONE(name) do {} while (0)
+#endif
+
+#endif /* TraceProfiler_hpp */
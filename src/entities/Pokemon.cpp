@@ -1,11 +1,9 @@
 #include "Pokemon.hpp"
+#include "../core/TraceProfiler.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <GLFW/glfw3.h>
 
-ALuint Pokemon::spinSoundBuffer = 0;
-bool Pokemon::spinSoundLoaded = false;
-
 Pokemon::Pokemon(const std::string& modelPath, const glm::vec3& startPos, float scale) 
     : position(startPos), initialPosition(startPos), scale(scale), angleY(0.0f), 
       isFlying(false), flightRadius(0.0f), flightHeight(0.0f), flightSpeed(0.0f), 
@@ -70,6 +68,7 @@ void Pokemon::stopJumping() {
 }
 
 void Pokemon::update(float deltaTime) {
+    TRACE_ZONE("Pokemon::update");
     currentTime += deltaTime;
     
     if (isFlying) {
@@ -91,7 +90,44 @@ void Pokemon::update(float deltaTime) {
     }
 }
 
-void Pokemon::draw(gps::Shader& shader) {
+void Pokemon::getBoundingSphere(glm::vec3& center, float& radius) const {
+    glm::vec3 boundsCenter = (model.getBoundsMin() + model.getBoundsMax()) * 0.5f;
+    float boundsRadius = glm::length(model.getBoundsMax() - model.getBoundsMin()) * 0.5f;
+
+    // the model only rotates around its local y axis, so keep the sphere on that axis
+    center = scale * (position + glm::vec3(0.0f, boundsCenter.y, 0.0f));
+    radius = scale * (boundsRadius + glm::length(glm::vec2(boundsCenter.x, boundsCenter.z)));
+}
+
+VoiceHandle Pokemon::emitSound(AudioManager& audioManager, SoundId sound, bool loop) {
+    VoiceHandle voice = audioManager.playSoundAt(sound, getSoundPosition(), loop);
+    if (voice.isValid()) {
+        voices.push_back(voice);
+    }
+    return voice;
+}
+
+void Pokemon::updateSounds(AudioManager& audioManager) {
+    glm::vec3 soundPosition = getSoundPosition();
+    size_t kept = 0;
+    for (size_t i = 0; i < voices.size(); i++) {
+        // finished, stopped and stolen voices drop out here
+        if (audioManager.isPlaying(voices[i])) {
+            audioManager.setPosition(voices[i], soundPosition);
+            voices[kept++] = voices[i];
+        }
+    }
+    voices.resize(kept);
+}
+
+glm::vec3 Pokemon::getSoundPosition() const {
+    float radius;
+    glm::vec3 center;
+    getBoundingSphere(center, radius);
+    return center;
+}
+
+glm::mat4 Pokemon::getModelMatrix() const {
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::scale(model, glm::vec3(scale));
     model = glm::translate(model, position);
@@ -119,10 +155,16 @@ void Pokemon::draw(gps::Shader& shader) {
     }
     
     model = glm::rotate(model, glm::radians(angleY), glm::vec3(0.0f, 1.0f, 0.0f));
-    
+
+    return model;
+}
+
+void Pokemon::draw(gps::Shader& shader) {
     glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 
-                      1, GL_FALSE, glm::value_ptr(model));
-    glUniform1i(glGetUniformLocation(shader.shaderProgram, "isSkydome"), 0);
-    
+                      1, GL_FALSE, glm::value_ptr(getModelMatrix()));
     this->model.Draw(shader);
+}
+
+void Pokemon::draw(gps::ShaderVariants& variants, unsigned sceneFeatures) {
+    this->model.Draw(variants, sceneFeatures, getModelMatrix());
 } 
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <string>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <vector>
 #include "../audio/AudioManager.hpp"
 
 class Pokemon {
@@ -13,6 +14,10 @@ public:
     Pokemon(const std::string& modelPath, const glm::vec3& startPos, float scale);
     void update(float deltaTime);
     void draw(gps::Shader& shader);
+    // each mesh picks its own variant and sets the model matrix on it
+    void draw(gps::ShaderVariants& variants, unsigned sceneFeatures);
+    // world space sphere enclosing the model for any spin or flight rotation
+    void getBoundingSphere(glm::vec3& center, float& radius) const;
     
     void setCircularFlight(float radius, float height, float speed);
     void setFigureEightFlight(float radius, float height, float speed);
@@ -21,12 +26,19 @@ public:
     void jump(float deltaTime);  
     void stopJumping();  
     
+    // plays from the centre of the Pokemon and follows it while it moves
+    VoiceHandle emitSound(AudioManager& audioManager, SoundId sound, bool loop = false);
+    // moves the emitted voices along, call once per frame after update
+    void updateSounds(AudioManager& audioManager);
+    
     glm::vec3 position;
     float scale;
     float angleY;
     
     bool isSpinning() const { return isJumping; }  
     
+    const gps::Model3D& getModel() const { return model; }
+
 private:
     gps::Model3D model;
     bool isFlying;
@@ -40,10 +52,11 @@ private:
     float jumpHeight;
     float jumpTime;
     bool isJumping;
+    glm::mat4 getModelMatrix() const;
     const float JUMP_DURATION = 0.5f;
     float MAX_JUMP_HEIGHT;
-    static ALuint spinSoundBuffer;
-    static bool spinSoundLoaded;
+    std::vector<VoiceHandle> voices;
+    glm::vec3 getSoundPosition() const;
 };
 
 #endif 
\ No newline at end of file
@@ -1,34 +1,68 @@
 #include "Rain.hpp"
+#include "../../core/TraceProfiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <glm/gtc/random.hpp>
 
-Rain::Rain(int numParticles) : numParticles(numParticles), rainEnabled(false) {
+// interleaved layout of a particle in the GPU buffers: position, size, velocity, lifetime
+static const GLsizei GPU_PARTICLE_STRIDE = 8 * sizeof(float);
+// layout of a drop in the draw buffers: position, size
+static const GLsizei DRAW_PARTICLE_STRIDE = 4 * sizeof(float);
+// world-space slack for the frustum test, covers point size and the wind offset in rain.vert
+static const float CULL_MARGIN = 2.0f;
+// upper bound on the impact events recorded in one update
+static const size_t MAX_IMPACTS_PER_FRAME = 4096;
+
+// matches the command layout glDrawArraysIndirect reads
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+Rain::Rain(int numParticles) : numParticles(numParticles), rainEnabled(false),
+    backend(Backend::CPU), updateShader(nullptr), cullShader(nullptr), currentBuffer(0),
+    volumeCenter(0.0f), volumeHalfExtents(60.0f, 50.0f, 60.0f), volumeForwardBias(0.6f),
+    heightfield(nullptr), emitImpacts(false),
+    viewerPosition(0.0f), lodFrame(0), drawCount(0) {
+    // near drops every frame at full count, thinner and larger further out,
+    // anything past the last tier is neither updated nor drawn
+    lodTiers = {
+        { 30.0f, -1, 1, 1.0f },
+        { 60.0f, 6000, 2, 1.5f },
+        { 120.0f, 2000, 4, 2.5f },
+    };
+    lodTierPopulation.assign(lodTiers.size(), 0);
+    lodTierLastPopulation.assign(lodTiers.size(), 0);
+    lodTierDrawn.assign(lodTiers.size(), 0);
+    lodTierDrops.resize(lodTiers.size());
+    impacts.reserve(MAX_IMPACTS_PER_FRAME);
+
     initialize();
 }
 
 Rain::~Rain() {
     glDeleteVertexArrays(1, &rainVAO);
     glDeleteBuffers(1, &rainVBO);
+    glDeleteVertexArrays(2, feedbackVAO);
+    glDeleteBuffers(2, feedbackVBO);
+    glDeleteBuffers(1, &indirectBuffer);
+    glDeleteVertexArrays(1, &cullVAO);
+    glDeleteBuffers(1, &cullVBO);
+    glDeleteTransformFeedbacks(1, &cullFeedback);
 }
 
 void Rain::initialize() {
     rainParticles.clear();
     rainParticles.reserve(numParticles);
 
-    const float xRange = 400.0f;
-    const float yRange = 200.0f;
-    const float scale = 1.0f;
-
     for (int i = 0; i < numParticles; ++i) {
         RainParticle particle;
 
-        float startingHeight = (rand() % (int)(yRange * 2));
-        
-        particle.position = glm::vec3(
-            (rand() % (int)xRange - xRange/2) / scale,
-            startingHeight,
-            (rand() % (int)xRange - xRange/2) / scale
-        );
+        particle.position = volumeCenter + glm::linearRand(-volumeHalfExtents, volumeHalfExtents);
 
         particle.velocity = glm::vec3(
             0.0f,
@@ -36,7 +70,8 @@ void Rain::initialize() {
             0.0f
         );
 
-        particle.lifetime = 10.0f + (startingHeight / 15.0f);
+        particle.lifetime = 0.0f;
+        particle.pendingTime = 0.0f;
         particle.size = 2.0f + (rand() % 20) / 10.0f;
         rainParticles.push_back(particle);
     }
@@ -51,20 +86,132 @@ void Rain::setupBuffers() {
     glBindVertexArray(rainVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, rainVBO);
-    glBufferData(GL_ARRAY_BUFFER, rainParticles.size() * (sizeof(glm::vec3) + sizeof(float)), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, rainParticles.size() * DRAW_PARTICLE_STRIDE, nullptr, GL_DYNAMIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, DRAW_PARTICLE_STRIDE, (void*)0);
+    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) + sizeof(float), (void*)0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, DRAW_PARTICLE_STRIDE, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    // the draw count of the compacted buffer lives in an indirect command
+    DrawArraysIndirectCommand command = { 0, 1, 0, 0 };
+    glGenBuffers(1, &indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // GPU backend: the cull pass streams visible drops into cullVBO, and the
+    // transform feedback object remembers how many were written
+    glGenVertexArrays(1, &cullVAO);
+    glGenBuffers(1, &cullVBO);
+
+    glBindVertexArray(cullVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, cullVBO);
+    glBufferData(GL_ARRAY_BUFFER, rainParticles.size() * DRAW_PARTICLE_STRIDE, nullptr, GL_DYNAMIC_COPY);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, DRAW_PARTICLE_STRIDE, (void*)0);
     glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) + sizeof(float), (void*)(sizeof(glm::vec3)));
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, DRAW_PARTICLE_STRIDE, (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    glGenTransformFeedbacks(1, &cullFeedback);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, cullFeedback);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cullVBO);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+    glGenVertexArrays(2, feedbackVAO);
+    glGenBuffers(2, feedbackVBO);
+
+    for (int i = 0; i < 2; ++i) {
+        glBindVertexArray(feedbackVAO[i]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, feedbackVBO[i]);
+        glBufferData(GL_ARRAY_BUFFER, rainParticles.size() * GPU_PARTICLE_STRIDE, nullptr, GL_DYNAMIC_COPY);
+
+        // position and size double as the rain.vert inputs when rendering
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, GPU_PARTICLE_STRIDE, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, GPU_PARTICLE_STRIDE, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, GPU_PARTICLE_STRIDE, (void*)(4 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, GPU_PARTICLE_STRIDE, (void*)(7 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+    }
+
     glBindVertexArray(0);
+
+    uploadGPUParticles();
+}
+
+void Rain::uploadGPUParticles() {
+    std::vector<float> data;
+    data.reserve(rainParticles.size() * 8);
+
+    for (const auto& particle : rainParticles) {
+        data.push_back(particle.position.x);
+        data.push_back(particle.position.y);
+        data.push_back(particle.position.z);
+        data.push_back(particle.size);
+        data.push_back(particle.velocity.x);
+        data.push_back(particle.velocity.y);
+        data.push_back(particle.velocity.z);
+        data.push_back(particle.lifetime);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, feedbackVBO[currentBuffer]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(float), data.data());
+}
+
+void Rain::downloadGPUParticles() {
+    std::vector<float> data(rainParticles.size() * 8);
+
+    glBindBuffer(GL_ARRAY_BUFFER, feedbackVBO[currentBuffer]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(float), data.data());
+
+    for (size_t i = 0; i < rainParticles.size(); ++i) {
+        const float* src = &data[i * 8];
+        rainParticles[i].position = glm::vec3(src[0], src[1], src[2]);
+        rainParticles[i].size = src[3];
+        rainParticles[i].velocity = glm::vec3(src[4], src[5], src[6]);
+        rainParticles[i].lifetime = src[7];
+        rainParticles[i].pendingTime = 0.0f;
+    }
+}
+
+void Rain::setBackend(Backend newBackend) {
+    if (newBackend == backend) return;
+
+    // hand the current state over so switching does not reset the rain
+    if (newBackend == Backend::GPU) {
+        uploadGPUParticles();
+    } else {
+        downloadGPUParticles();
+    }
+    backend = newBackend;
+}
+
+void Rain::toggleBackend() {
+    setBackend(backend == Backend::CPU ? Backend::GPU : Backend::CPU);
 }
 
 void Rain::update(float deltaTime, const glm::vec3& windDirection, float windStrength) {
+    TRACE_ZONE("Rain::update");
+    // only the CPU backend reports impacts, so splashes stop with the GPU one
+    impacts.clear();
     if (!rainEnabled) return;
 
+    if (backend == Backend::GPU) {
+        updateOnGPU(deltaTime, windDirection, windStrength);
+        return;
+    }
+
     const float windFactor = windStrength * 0.2f;
     const float velocityDamping = 0.95f;
     static bool wasWindEnabled = false;
@@ -77,60 +224,261 @@ void Rain::update(float deltaTime, const glm::vec3& windDirection, float windStr
     }
     wasWindEnabled = isWindEnabled;
     
-    for (auto& particle : rainParticles) {
+    const glm::vec3 volumeMin = volumeCenter - volumeHalfExtents;
+    const glm::vec3 volumeSize = volumeHalfExtents * 2.0f;
+
+    // wrap around the volume instead of respawning, so drops that leave
+    // one side (or the bottom) re-enter on the opposite one
+    auto wrapIntoVolume = [&](RainParticle& particle) {
+        glm::vec3 offset = particle.position - volumeMin;
+        offset -= volumeSize * glm::floor(offset / volumeSize);
+        particle.position = volumeMin + offset;
+    };
+
+    ++lodFrame;
+
+    for (size_t i = 0; i < rainParticles.size(); ++i) {
+        RainParticle& particle = rainParticles[i];
+
+        // distant tiers are stepped every few frames with the time owed since the
+        // last step, so moving between tiers never steps a drop twice or loses time
+        int tier = lodTierFor(particle.position);
+        if (tier < 0) {
+            // past the last tier nothing is drawn, so the drop is not simulated and
+            // only rewrapped for when the volume has moved on
+            particle.pendingTime = 0.0f;
+            wrapIntoVolume(particle);
+            continue;
+        }
+        particle.pendingTime += deltaTime;
+        int interval = lodTiers[tier].updateInterval;
+        if (interval > 1 && (lodFrame + i) % interval != 0) continue;
+        float stepTime = particle.pendingTime;
+        particle.pendingTime = 0.0f;
+
         if (isWindEnabled) {
-            particle.velocity.x = particle.velocity.x * velocityDamping + windDirection.x * windFactor;
-            particle.velocity.z = particle.velocity.z * velocityDamping + windDirection.z * windFactor;
+            // the per-frame damp-and-push applied for every frame the step covers, in
+            // closed form, so skipped tiers follow wind changes as fast as near ones
+            float frames = deltaTime > 0.0f ? stepTime / deltaTime : 1.0f;
+            float damping = std::pow(velocityDamping, frames);
+            float windGain = windFactor * (1.0f - damping) / (1.0f - velocityDamping);
+            particle.velocity.x = particle.velocity.x * damping + windDirection.x * windGain;
+            particle.velocity.z = particle.velocity.z * damping + windDirection.z * windGain;
         } else {
             particle.velocity.x = 0.0f;
             particle.velocity.z = 0.0f;
             particle.velocity.y = -25.0f;
         }
         
-        particle.position += particle.velocity * deltaTime;
-        particle.lifetime -= deltaTime;
-
-        if (particle.lifetime <= 0.0f || particle.position.y < -20.0f) {
-            float newHeight = (rand() % 200) + 50.0f;
-            
-            particle.position = glm::vec3(
-                (rand() % 400 - 200),
-                newHeight,
-                (rand() % 400 - 200)
-            );
-            
-            if (isWindEnabled) {
-                particle.velocity = glm::vec3(
-                    windDirection.x * windStrength * 0.1f,
-                    -25.0f,
-                    windDirection.z * windStrength * 0.1f
-                );
-            } else {
-                particle.velocity = glm::vec3(0.0f, -25.0f, 0.0f);
+        particle.position += particle.velocity * stepTime;
+
+        if (heightfield && heightfield->isBaked()) {
+            float groundHeight = heightfield->sample(particle.position.x, particle.position.z);
+            if (particle.position.y < groundHeight) {
+                if (emitImpacts && impacts.size() < MAX_IMPACTS_PER_FRAME) {
+                    impacts.push_back(glm::vec3(particle.position.x, groundHeight, particle.position.z));
+                }
+                particle.position.y = volumeMin.y + volumeSize.y - 0.001f;
             }
-            
-            particle.lifetime = 20.0f + (newHeight / 15.0f);
+        }
+
+        wrapIntoVolume(particle);
+    }
+}
+
+void Rain::followCamera(const glm::vec3& cameraPosition, const glm::vec3& cameraFront) {
+    // push the volume ahead of the viewer so most drops land inside the frustum
+    glm::vec3 forward(cameraFront.x, 0.0f, cameraFront.z);
+    if (glm::dot(forward, forward) > 1e-6f) {
+        forward = glm::normalize(forward);
+    }
+
+    viewerPosition = cameraPosition;
+    volumeCenter = cameraPosition + forward * (volumeHalfExtents.x * volumeForwardBias);
+    volumeCenter.y = cameraPosition.y + volumeHalfExtents.y * 0.4f;
+}
+
+void Rain::setLodTier(int index, const LodTier& tier) {
+    if (index < 0 || index >= (int)lodTiers.size()) return;
+    lodTiers[index] = tier;
+}
+
+int Rain::lodTierFor(const glm::vec3& position) const {
+    glm::vec3 toViewer = position - viewerPosition;
+    float distanceSquared = glm::dot(toViewer, toViewer);
+
+    for (size_t tier = 0; tier < lodTiers.size(); ++tier) {
+        if (distanceSquared < lodTiers[tier].maxDistance * lodTiers[tier].maxDistance) {
+            return (int)tier;
         }
     }
+    return -1;
 }
 
-void Rain::updateBuffer() {
+void Rain::updateOnGPU(float deltaTime, const glm::vec3& windDirection, float windStrength) {
+    if (!updateShader) return;
+
+    updateShader->useShaderProgram();
+    glUniform1f(glGetUniformLocation(updateShader->shaderProgram, "deltaTime"), deltaTime);
+    glUniform3fv(glGetUniformLocation(updateShader->shaderProgram, "windDirection"), 1, &windDirection[0]);
+    glUniform1f(glGetUniformLocation(updateShader->shaderProgram, "windStrength"), windStrength);
+    glUniform3fv(glGetUniformLocation(updateShader->shaderProgram, "volumeCenter"), 1, &volumeCenter[0]);
+    glUniform3fv(glGetUniformLocation(updateShader->shaderProgram, "volumeHalfExtents"), 1, &volumeHalfExtents[0]);
+
+    bool hasHeightfield = heightfield && heightfield->isBaked();
+    glUniform1i(glGetUniformLocation(updateShader->shaderProgram, "hasHeightfield"), hasHeightfield ? 1 : 0);
+    if (hasHeightfield) {
+        glm::vec2 heightfieldOrigin = heightfield->getOrigin();
+        glm::vec2 heightfieldSize = heightfield->getSize();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, heightfield->getTexture());
+        glUniform1i(glGetUniformLocation(updateShader->shaderProgram, "heightfield"), 0);
+        glUniform2fv(glGetUniformLocation(updateShader->shaderProgram, "heightfieldOrigin"), 1, &heightfieldOrigin[0]);
+        glUniform2fv(glGetUniformLocation(updateShader->shaderProgram, "heightfieldSize"), 1, &heightfieldSize[0]);
+    }
+
+    int nextBuffer = 1 - currentBuffer;
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(feedbackVAO[currentBuffer]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackVBO[nextBuffer]);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, rainParticles.size());
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    currentBuffer = nextBuffer;
+}
+
+void Rain::extractFrustumPlanes(const glm::mat4& viewProjection) {
+    // Gribb-Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    for (int i = 0; i < 3; ++i) {
+        for (int side = 0; side < 2; ++side) {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            glm::vec4 plane(
+                viewProjection[0][3] + sign * viewProjection[0][i],
+                viewProjection[1][3] + sign * viewProjection[1][i],
+                viewProjection[2][3] + sign * viewProjection[2][i],
+                viewProjection[3][3] + sign * viewProjection[3][i]
+            );
+            frustumPlanes[i * 2 + side] = plane / glm::length(glm::vec3(plane));
+        }
+    }
+}
+
+bool Rain::isInFrustum(const glm::vec3& position) const {
+    for (const glm::vec4& plane : frustumPlanes) {
+        if (glm::dot(glm::vec3(plane), position) + plane.w < -CULL_MARGIN) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Rain::updateBuffer(const glm::mat4& viewProjection) {
+    TRACE_ZONE("Rain::updateBuffer");
+    extractFrustumPlanes(viewProjection);
+
+    if (backend == Backend::GPU) {
+        cullOnGPU();
+        return;
+    }
+
     static std::vector<float> data;
     data.clear();
     data.reserve(rainParticles.size() * 4);
 
-    for (const auto& particle : rainParticles) {
-        data.push_back(particle.position.x);
-        data.push_back(particle.position.y);
-        data.push_back(particle.position.z);
-        data.push_back(particle.size);
+    for (size_t tier = 0; tier < lodTiers.size(); ++tier) {
+        lodTierPopulation[tier] = 0;
+        lodTierDrawn[tier] = 0;
+        lodTierDrops[tier].clear();
+    }
+
+    for (size_t i = 0; i < rainParticles.size(); ++i) {
+        const RainParticle& particle = rainParticles[i];
+
+        int tier = lodTierFor(particle.position);
+        if (tier < 0) continue;
+        if (!isInFrustum(particle.position)) continue;
+
+        const LodTier& lod = lodTiers[tier];
+        ++lodTierPopulation[tier];
+
+        if (lod.budget >= 0) {
+            if (lodTierDrawn[tier] >= lod.budget) continue;
+
+            // keep a stable pseudo-random subset sized from last frame's population,
+            // so the same drops stay visible instead of flickering between frames
+            int population = std::max(lodTierLastPopulation[tier], 1);
+            float keepRatio = (float)lod.budget / (float)population;
+            float selector = (float)((uint32_t)i * 2654435761u) / 4294967296.0f;
+            if (selector >= keepRatio) continue;
+        }
+        ++lodTierDrawn[tier];
+
+        std::vector<float>& drops = lodTierDrops[tier];
+        drops.push_back(particle.position.x);
+        drops.push_back(particle.position.y);
+        drops.push_back(particle.position.z);
+        drops.push_back(particle.size * lod.sizeScale);
+    }
+
+    // farthest tier first, so the blended drops are roughly sorted back to front
+    for (size_t tier = lodTiers.size(); tier-- > 0;) {
+        data.insert(data.end(), lodTierDrops[tier].begin(), lodTierDrops[tier].end());
     }
 
+    lodTierLastPopulation = lodTierPopulation;
+    drawCount = (GLsizei)(data.size() / 4);
+
     glBindBuffer(GL_ARRAY_BUFFER, rainVBO);
     glBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(float), data.data());
+
+    DrawArraysIndirectCommand command = { (GLuint)drawCount, 1, 0, 0 };
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Rain::cullOnGPU() {
+    if (!cullShader) return;
+
+    cullShader->useShaderProgram();
+    glUniform4fv(glGetUniformLocation(cullShader->shaderProgram, "frustumPlanes"), 6, &frustumPlanes[0][0]);
+    glUniform1f(glGetUniformLocation(cullShader->shaderProgram, "cullMargin"), CULL_MARGIN);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(feedbackVAO[currentBuffer]);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, cullFeedback);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, rainParticles.size());
+    glEndTransformFeedback();
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
 }
 
 void Rain::render() {
+    if (backend == Backend::GPU) {
+        if (cullShader) {
+            // draws exactly what the cull pass wrote, without reading the count back
+            glBindVertexArray(cullVAO);
+            glDrawTransformFeedback(GL_POINTS, cullFeedback);
+        } else {
+            glBindVertexArray(feedbackVAO[currentBuffer]);
+            glDrawArrays(GL_POINTS, 0, rainParticles.size());
+        }
+        return;
+    }
+
     glBindVertexArray(rainVAO);
-    glDrawArrays(GL_POINTS, 0, rainParticles.size());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glDrawArraysIndirect(GL_POINTS, (void*)0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 } 
\ No newline at end of file
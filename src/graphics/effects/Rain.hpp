@@ -10,6 +10,8 @@
 #endif
 
 #include <GLFW/glfw3.h>
+#include "../shaders/Shader.hpp"
+#include "../models/Heightfield.hpp"
 
 class Rain {
 public:
@@ -18,20 +20,56 @@ public:
         glm::vec3 velocity;
         float lifetime;
         float size;
+        float pendingTime;   // simulated time owed since the last LOD step, CPU only
     };
 
-    Rain(int numParticles = 100000);
+    // CPU simulates in rainParticles and uploads every frame,
+    // GPU keeps the particles in buffers and advances them with transform feedback
+    enum class Backend { CPU, GPU };
+
+    // distance band around the camera; particles beyond the last tier are not drawn
+    struct LodTier {
+        float maxDistance;
+        int budget;          // max drops drawn from this tier per frame, -1 for all
+        int updateInterval;  // simulate every N frames with an N times longer step
+        float sizeScale;     // grows the remaining drops to keep perceived density
+    };
+
+    Rain(int numParticles = 20000);
     ~Rain();
 
     void initialize();
     void setupBuffers();
     void update(float deltaTime, const glm::vec3& windDirection, float windStrength);
-    void updateBuffer();
+    // recenters the simulated volume around the viewer, call before update()
+    void followCamera(const glm::vec3& cameraPosition, const glm::vec3& cameraFront);
+    // culls against the view frustum and packs the visible drops for render()
+    void updateBuffer(const glm::mat4& viewProjection);
     void render();
 
     bool isEnabled() const { return rainEnabled; }
     void toggleEnabled() { rainEnabled = !rainEnabled; }
 
+    Backend getBackend() const { return backend; }
+    void setBackend(Backend newBackend);
+    void toggleBackend();
+    void setUpdateShader(gps::Shader* shader) { updateShader = shader; }
+    void setCullShader(gps::Shader* shader) { cullShader = shader; }
+
+    // drops hitting the terrain wrap back to the top of the volume
+    void setHeightfield(const gps::Heightfield* terrain) { heightfield = terrain; }
+    // ground positions where drops landed during the last update, capped per frame;
+    // always empty on the GPU backend, which does not read particles back
+    void setEmitImpacts(bool emit) { emitImpacts = emit; }
+    const std::vector<glm::vec3>& getImpacts() const { return impacts; }
+
+    void setVolumeHalfExtents(const glm::vec3& halfExtents) { volumeHalfExtents = halfExtents; }
+    void setVolumeForwardBias(float bias) { volumeForwardBias = bias; }
+
+    const std::vector<LodTier>& getLodTiers() const { return lodTiers; }
+    void setLodTier(int index, const LodTier& tier);
+    GLsizei getDrawCount() const { return drawCount; }
+
     std::vector<RainParticle>& getParticles() { return rainParticles; }
 
 private:
@@ -40,6 +78,47 @@ private:
     GLuint rainVAO, rainVBO;
     bool rainEnabled;
     GLuint instanceVBO;
+
+    // GPU backend, ping-ponged between the two buffers every update
+    Backend backend;
+    gps::Shader* updateShader;
+    gps::Shader* cullShader;
+    GLuint feedbackVAO[2], feedbackVBO[2];
+    GLuint cullVAO, cullVBO, cullFeedback;
+    int currentBuffer;
+
+    // frustum culling and compaction
+    glm::vec4 frustumPlanes[6];
+    GLuint indirectBuffer;
+    std::vector<std::vector<float>> lodTierDrops;
+
+    // camera-relative box the particles live and wrap in
+    glm::vec3 volumeCenter;
+    glm::vec3 volumeHalfExtents;
+    float volumeForwardBias;
+
+    // terrain collision
+    const gps::Heightfield* heightfield;
+    bool emitImpacts;
+    std::vector<glm::vec3> impacts;
+
+    // distance level of detail, CPU backend only
+    glm::vec3 viewerPosition;
+    std::vector<LodTier> lodTiers;
+    std::vector<int> lodTierPopulation;
+    std::vector<int> lodTierLastPopulation;
+    std::vector<int> lodTierDrawn;
+    unsigned int lodFrame;
+    GLsizei drawCount;
+
+    int lodTierFor(const glm::vec3& position) const;
+    void extractFrustumPlanes(const glm::mat4& viewProjection);
+    bool isInFrustum(const glm::vec3& position) const;
+    void cullOnGPU();
+
+    void updateOnGPU(float deltaTime, const glm::vec3& windDirection, float windStrength);
+    void uploadGPUParticles();
+    void downloadGPUParticles();
 };
 
-#endif 
\ No newline at end of file
+#endif
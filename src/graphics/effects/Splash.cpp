@@ -0,0 +1,118 @@
+#include "Splash.hpp"
+#include "../../core/TraceProfiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+Splash::Splash(int capacity) : capacity(capacity), head(0), count(0), dirtyStart(0), dirtyCount(0),
+    clock(0.0f), lifetime(0.4f), dropsPerSplash(6), maxEmitsPerFrame(4096),
+    frameMicroseconds(0.0), lastFrameMicroseconds(0.0) {
+    instances.resize(capacity);
+    setupBuffers();
+}
+
+Splash::~Splash() {
+    glDeleteVertexArrays(1, &splashVAO);
+    glDeleteBuffers(1, &splashVBO);
+}
+
+void Splash::setupBuffers() {
+    glGenVertexArrays(1, &splashVAO);
+    glGenBuffers(1, &splashVBO);
+
+    glBindVertexArray(splashVAO);
+
+    // the ring is mirrored twice in the buffer so the live range [head, head + count)
+    // is always contiguous and can be drawn with a single call
+    glBindBuffer(GL_ARRAY_BUFFER, splashVBO);
+    glBufferData(GL_ARRAY_BUFFER, 2 * capacity * sizeof(SplashInstance), nullptr, GL_DYNAMIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SplashInstance), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribDivisor(0, 1);
+
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(SplashInstance), (void*)offsetof(SplashInstance, birthTime));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glBindVertexArray(0);
+}
+
+void Splash::emit(const std::vector<glm::vec3>& impacts) {
+    TRACE_ZONE("Splash::emit");
+    auto start = std::chrono::steady_clock::now();
+
+    int emits = std::min((int)impacts.size(), std::min(maxEmitsPerFrame, capacity));
+    if (emits > 0) {
+        int tail = (head + count) % capacity;
+        if (dirtyCount == 0) {
+            dirtyStart = tail;
+        }
+
+        for (int i = 0; i < emits; ++i) {
+            instances[(tail + i) % capacity] = { impacts[i], clock };
+        }
+
+        dirtyCount = std::min(dirtyCount + emits, capacity);
+        count += emits;
+        if (count > capacity) {
+            head = (head + count - capacity) % capacity;
+            count = capacity;
+        }
+    }
+
+    frameMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Splash::update(float deltaTime) {
+    TRACE_ZONE("Splash::update");
+    auto start = std::chrono::steady_clock::now();
+
+    clock += deltaTime;
+
+    // every splash lives equally long, so the expired ones are always at the head
+    while (count > 0 && clock - instances[head].birthTime >= lifetime) {
+        head = (head + 1) % capacity;
+        --count;
+    }
+
+    frameMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    lastFrameMicroseconds = frameMicroseconds;
+    frameMicroseconds = 0.0;
+}
+
+void Splash::updateBuffer() {
+    if (dirtyCount == 0) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, splashVBO);
+
+    // upload only the new slots, into both copies of the ring
+    int first = dirtyStart;
+    int remaining = dirtyCount;
+    while (remaining > 0) {
+        int run = std::min(remaining, capacity - first);
+        GLsizeiptr bytes = run * sizeof(SplashInstance);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(SplashInstance), bytes, &instances[first]);
+        glBufferSubData(GL_ARRAY_BUFFER, (capacity + first) * sizeof(SplashInstance), bytes, &instances[first]);
+        remaining -= run;
+        first = 0;
+    }
+
+    dirtyCount = 0;
+}
+
+void Splash::render() {
+    if (count == 0) return;
+
+    glBindVertexArray(splashVAO);
+
+    // point the instance attributes at the oldest live splash
+    glBindBuffer(GL_ARRAY_BUFFER, splashVBO);
+    size_t offset = head * sizeof(SplashInstance);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SplashInstance), (void*)offset);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(SplashInstance),
+                          (void*)(offset + offsetof(SplashInstance, birthTime)));
+
+    glDrawArraysInstanced(GL_POINTS, 0, dropsPerSplash, count);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,62 @@
+#ifndef SPLASH_HPP
+#define SPLASH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+#if defined (__APPLE__)
+    #define GLFW_INCLUDE_GLCOREARB
+#else
+    #include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+// Short-lived splashes spawned where rain hits the ground. Splashes live in a
+// fixed-capacity ring buffer and are drawn as one instanced call, each instance
+// expanding into a few droplets in splash.vert.
+class Splash {
+public:
+    struct SplashInstance {
+        glm::vec3 position;
+        float birthTime;
+    };
+
+    Splash(int capacity = 16384);
+    ~Splash();
+
+    void setupBuffers();
+    // queues new splashes, overwriting the oldest ones when the ring is full
+    void emit(const std::vector<glm::vec3>& impacts);
+    void update(float deltaTime);
+    void updateBuffer();
+    void render();
+
+    float getTime() const { return clock; }
+    float getLifetime() const { return lifetime; }
+    int getDropsPerSplash() const { return dropsPerSplash; }
+    int getActiveCount() const { return count; }
+
+    void setMaxEmitsPerFrame(int maxEmits) { maxEmitsPerFrame = maxEmits; }
+    // CPU time spent in emit() and update() during the last frame
+    double getLastFrameMicroseconds() const { return lastFrameMicroseconds; }
+
+private:
+    std::vector<SplashInstance> instances;
+    int capacity;
+    int head;
+    int count;
+    // slots written since the last upload, as a run starting at dirtyStart
+    int dirtyStart;
+    int dirtyCount;
+
+    float clock;
+    float lifetime;
+    int dropsPerSplash;
+    int maxEmitsPerFrame;
+    double frameMicroseconds;
+    double lastFrameMicroseconds;
+
+    GLuint splashVAO, splashVBO;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "Heightfield.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace gps {
+
+	Heightfield::Heightfield() : resolution(0), origin(0.0f), size(0.0f), inverseCellSize(0.0f), texture(0) {
+	}
+
+	Heightfield::~Heightfield() {
+
+		if (texture) {
+			glDeleteTextures(1, &texture);
+		}
+	}
+
+	void Heightfield::bake(const gps::Model3D& model, const glm::mat4& modelMatrix, int resolution) {
+
+		this->resolution = resolution;
+
+		// world space triangles and their XZ bounds
+		std::vector<glm::vec3> triangles;
+		glm::vec3 boundsMin(FLT_MAX);
+		glm::vec3 boundsMax(-FLT_MAX);
+
+		for (const gps::Mesh& mesh : model.getMeshes()) {
+
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+
+				glm::vec3 a = glm::vec3(modelMatrix * glm::vec4(mesh.vertices[mesh.indices[i]].Position, 1.0f));
+				glm::vec3 b = glm::vec3(modelMatrix * glm::vec4(mesh.vertices[mesh.indices[i + 1]].Position, 1.0f));
+				glm::vec3 c = glm::vec3(modelMatrix * glm::vec4(mesh.vertices[mesh.indices[i + 2]].Position, 1.0f));
+
+				boundsMin = glm::min(boundsMin, glm::min(a, glm::min(b, c)));
+				boundsMax = glm::max(boundsMax, glm::max(a, glm::max(b, c)));
+
+				// only surfaces rain can land on; this also skips walls and the inside of a sky dome
+				if (glm::cross(b - a, c - a).y <= 0.0f) {
+					continue;
+				}
+
+				triangles.push_back(a);
+				triangles.push_back(b);
+				triangles.push_back(c);
+			}
+		}
+
+		if (triangles.empty()) {
+			heights.clear();
+			return;
+		}
+
+		origin = glm::vec2(boundsMin.x, boundsMin.z);
+		size = glm::vec2(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+		glm::vec2 cellSize = size / (float)resolution;
+		inverseCellSize = glm::vec2(1.0f / cellSize.x, 1.0f / cellSize.y);
+
+		// cells no triangle covers fall back to the lowest point of the model
+		heights.assign(resolution * resolution, boundsMin.y);
+
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+
+			const glm::vec3& a = triangles[t];
+			const glm::vec3& b = triangles[t + 1];
+			const glm::vec3& c = triangles[t + 2];
+
+			float minX = std::min(a.x, std::min(b.x, c.x));
+			float maxX = std::max(a.x, std::max(b.x, c.x));
+			float minZ = std::min(a.z, std::min(b.z, c.z));
+			float maxZ = std::max(a.z, std::max(b.z, c.z));
+
+			int firstX = std::max((int)((minX - origin.x) * inverseCellSize.x), 0);
+			int lastX = std::min((int)((maxX - origin.x) * inverseCellSize.x), resolution - 1);
+			int firstZ = std::max((int)((minZ - origin.y) * inverseCellSize.y), 0);
+			int lastZ = std::min((int)((maxZ - origin.y) * inverseCellSize.y), resolution - 1);
+
+			float area = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+			if (area == 0.0f) {
+				continue;
+			}
+
+			for (int cellZ = firstZ; cellZ <= lastZ; cellZ++) {
+				for (int cellX = firstX; cellX <= lastX; cellX++) {
+
+					// barycentric coordinates of the cell center in the XZ plane
+					float x = origin.x + (cellX + 0.5f) * cellSize.x;
+					float z = origin.y + (cellZ + 0.5f) * cellSize.y;
+					float u = ((b.x - x) * (c.z - z) - (c.x - x) * (b.z - z)) / area;
+					float v = ((c.x - x) * (a.z - z) - (a.x - x) * (c.z - z)) / area;
+					float w = 1.0f - u - v;
+
+					if (u < 0.0f || v < 0.0f || w < 0.0f) {
+						continue;
+					}
+
+					float height = u * a.y + v * b.y + w * c.y;
+					float& cell = heights[cellZ * resolution + cellX];
+					cell = std::max(cell, height);
+				}
+			}
+		}
+
+		std::cout << "Baked heightfield : " << resolution << "x" << resolution << std::endl;
+
+		uploadTexture();
+	}
+
+	void Heightfield::uploadTexture() {
+
+		if (!texture) {
+			glGenTextures(1, &texture);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, resolution, resolution, 0, GL_RED, GL_FLOAT, heights.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
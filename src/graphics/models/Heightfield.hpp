@@ -0,0 +1,51 @@
+#ifndef Heightfield_hpp
+#define Heightfield_hpp
+
+#include "Model3D.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Top surface of a model baked into a regular XZ grid, so point-vs-terrain
+    // queries are a single array lookup instead of a mesh intersection
+    class Heightfield {
+
+    public:
+        Heightfield();
+        ~Heightfield();
+
+        // rasterizes the upward-facing triangles of the model (in world space) into the grid
+        void bake(const gps::Model3D& model, const glm::mat4& modelMatrix, int resolution = 256);
+
+        bool isBaked() const { return !heights.empty(); }
+
+        // nearest-cell lookup, positions outside the grid use the closest edge cell
+        float sample(float x, float z) const {
+            int cellX = (int)((x - origin.x) * inverseCellSize.x);
+            int cellZ = (int)((z - origin.y) * inverseCellSize.y);
+            cellX = cellX < 0 ? 0 : (cellX >= resolution ? resolution - 1 : cellX);
+            cellZ = cellZ < 0 ? 0 : (cellZ >= resolution ? resolution - 1 : cellZ);
+            return heights[cellZ * resolution + cellX];
+        }
+
+        // same grid as a single channel float texture, for sampling in shaders
+        GLuint getTexture() const { return texture; }
+        glm::vec2 getOrigin() const { return origin; }
+        glm::vec2 getSize() const { return size; }
+
+    private:
+        std::vector<float> heights;
+        int resolution;
+        glm::vec2 origin;
+        glm::vec2 size;
+        glm::vec2 inverseCellSize;
+        GLuint texture;
+
+        void uploadTexture();
+    };
+}
+
+#endif /* Heightfield_hpp */
@@ -1,12 +1,34 @@
 #include "Mesh.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cctype>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	           Material material, std::string name) {
 
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->material = material;
+		this->name = name;
+
+		this->materialFeatures = 0;
+		for (const Texture& texture : this->textures) {
+			if (texture.type == "diffuseTexture") {
+				this->materialFeatures |= ShaderVariants::DIFFUSE_MAP;
+			} else if (texture.type == "specularTexture") {
+				this->materialFeatures |= ShaderVariants::SPECULAR_MAP;
+			}
+		}
+		std::string lowerName = name;
+		std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(),
+		               [](unsigned char c) { return (char)std::tolower(c); });
+		if (lowerName.find("sky") != std::string::npos) {
+			this->materialFeatures |= ShaderVariants::SKYDOME;
+		}
 
 		this->setupMesh();
 	}
@@ -16,7 +38,7 @@ namespace gps {
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::Draw(gps::Shader& shader)	{
 
 		shader.useShaderProgram();
 
@@ -27,6 +49,9 @@ namespace gps {
 			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
+		//only declared by the variants without the matching texture
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "materialDiffuse"), 1, &this->material.diffuse[0]);
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "materialSpecular"), 1, &this->material.specular[0]);
 
 		glBindVertexArray(this->buffers.VAO);
 		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
@@ -40,6 +65,14 @@ namespace gps {
 
     }
 
+	void Mesh::Draw(gps::ShaderVariants& variants, unsigned sceneFeatures, const glm::mat4& model) {
+
+		gps::Shader& shader = variants.get(sceneFeatures | this->materialFeatures);
+		shader.useShaderProgram();
+		glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+		Draw(shader);
+	}
+
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh() {
 
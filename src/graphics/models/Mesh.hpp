@@ -11,6 +11,7 @@
 #include <glm/glm.hpp>
 
 #include "../shaders/Shader.hpp"
+#include "../shaders/ShaderVariants.hpp"
 
 #include <string>
 #include <vector>
@@ -52,16 +53,28 @@ namespace gps {
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
+        // colors used where the matching texture is missing
+        Material material;
+        std::string name;
 
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	         Material material, std::string name);
 
 	    Buffers getBuffers();
 
-	    void Draw(gps::Shader shader);
+	    void Draw(gps::Shader& shader);
+	    // draws with the cheapest variant covering the scene features and this mesh's
+	    // material, the model matrix only goes to that variant
+	    void Draw(gps::ShaderVariants& variants, unsigned sceneFeatures, const glm::mat4& model);
+
+	    // ShaderVariants feature bits for the textures this mesh has, sky meshes are
+	    // recognised by "sky" in their object or material name
+	    unsigned getMaterialFeatures() const { return materialFeatures; }
 
     private:
         /*  Render data  */
         Buffers buffers;
+        unsigned materialFeatures;
 
 	    // Initializes all the buffer objects/arrays
 	    void setupMesh();
@@ -1,4 +1,5 @@
 #include "Model3D.hpp"
+#include "../../core/TraceProfiler.hpp"
 
 namespace gps {
 
@@ -14,15 +15,23 @@ namespace gps {
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	void Model3D::Draw(gps::Shader& shaderProgram) {
 
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	void Model3D::Draw(gps::ShaderVariants& variants, unsigned sceneFeatures, const glm::mat4& model) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(variants, sceneFeatures, model);
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
 
+		TRACE_ZONE("Model3D::ReadOBJ");
+
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
@@ -46,12 +55,18 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		boundsMin = glm::vec3(std::numeric_limits<float>::max());
+		boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
 			std::vector<gps::Vertex> vertices;
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
+			// untextured meshes without a material stay light gray instead of black
+			gps::Material currentMaterial = { glm::vec3(0.8f), glm::vec3(0.8f), glm::vec3(0.0f) };
+			std::string meshName = shapes[s].name;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -84,6 +99,8 @@ namespace gps {
 					}
 
 					glm::vec3 vertexPosition(vx, vy, vz);
+					boundsMin = glm::min(boundsMin, vertexPosition);
+					boundsMax = glm::max(boundsMax, vertexPosition);
 					glm::vec3 vertexNormal(nx, ny, nz);
 					glm::vec2 vertexTexCoords(tx, ty);
 
@@ -109,7 +126,7 @@ namespace gps {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
 
-					gps::Material currentMaterial;
+					meshName += " " + materials[materialId].name;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -146,7 +163,7 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.push_back(gps::Mesh(vertices, indices, textures, currentMaterial, meshName));
 		}
 	}
 
@@ -7,6 +7,7 @@
 #include "../../utils/stb_image.h"
 
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -21,13 +22,25 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		void Draw(gps::Shader& shaderProgram);
+
+		// each mesh picks its own variant, see Mesh::getMaterialFeatures, and gets
+		// the model matrix set on it
+		void Draw(gps::ShaderVariants& variants, unsigned sceneFeatures, const glm::mat4& model);
+
+		const std::vector<gps::Mesh>& getMeshes() const { return meshes; }
+
+		// Object space bounding box of all meshes
+		glm::vec3 getBoundsMin() const { return boundsMin; }
+		glm::vec3 getBoundsMax() const { return boundsMax; }
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
@@ -7,8 +7,14 @@
 //
 
 #include "Shader.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
 
 namespace gps {
+    std::string Shader::binaryCacheDirectory = "shader_cache";
+    bool Shader::parallelCompile = false;
+
     std::string Shader::readShaderFile(std::string fileName) {
 
         std::ifstream shaderFile;
@@ -29,8 +35,117 @@ namespace gps {
         shaderString = shaderStringStream.str();
         return shaderString;
     }
+
+    std::string Shader::preprocessShaderFile(const std::string& fileName, std::vector<std::string>& includedFiles) {
+
+        //every file is pasted once per stage, which also stops include cycles
+        std::string normalizedName = std::filesystem::path(fileName).lexically_normal().generic_string();
+        if (std::find(includedFiles.begin(), includedFiles.end(), normalizedName) != includedFiles.end()) {
+            return "";
+        }
+        int sourceIndex = (int)includedFiles.size();
+        includedFiles.push_back(normalizedName);
+
+        if (!std::filesystem::exists(normalizedName)) {
+            std::cerr << "Shader file not found: " << normalizedName << std::endl;
+            return "";
+        }
+
+        //#line keeps compile errors pointing at the right file, see finishLoad for the index
+        std::stringstream source(readShaderFile(normalizedName));
+        std::stringstream output;
+        std::filesystem::path directory = std::filesystem::path(normalizedName).parent_path();
+        std::string line;
+        int lineNumber = 0;
+        std::vector<Conditional> conditionals;
+        while (std::getline(source, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line[start] == '#') {
+                trackConditional(line.substr(start + 1), conditionals);
+            }
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                output << line << "\n";
+                continue;
+            }
+            //an include the defines compile out is neither pasted nor tracked
+            if (!conditionals.empty() && !conditionals.back().active) {
+                output << "\n";
+                continue;
+            }
+
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cerr << normalizedName << ":" << lineNumber << ": malformed #include" << std::endl;
+                output << "\n";
+                continue;
+            }
+            //paths are relative to the including file
+            std::string includeName = (directory / line.substr(open + 1, close - open - 1)).generic_string();
+            output << "#line 1 " << includedFiles.size() << "\n"
+                   << preprocessShaderFile(includeName, includedFiles)
+                   << "#line " << lineNumber + 1 << " " << sourceIndex << "\n";
+        }
+        return output.str();
+    }
     
-    void Shader::shaderCompileLog(GLuint shaderId) {
+    void Shader::trackConditional(const std::string& directive, std::vector<Conditional>& conditionals) {
+
+        std::stringstream tokens(directive);
+        std::string keyword, name;
+        tokens >> keyword >> name;
+        bool parentActive = conditionals.empty() || conditionals.back().active;
+
+        //only #ifdef and #ifndef on the injected defines are decided here, any #if or
+        //#elif expression is left to the GLSL compiler and its includes are kept
+        if (keyword == "ifdef" || keyword == "ifndef") {
+            bool defined = std::find(defines.begin(), defines.end(), name) != defines.end();
+            bool taken = keyword == "ifdef" ? defined : !defined;
+            conditionals.push_back({ parentActive, parentActive && taken, taken, true });
+        } else if (keyword == "if") {
+            conditionals.push_back({ parentActive, parentActive, false, false });
+        } else if (conditionals.empty()) {
+            return;
+        } else if (keyword == "elif") {
+            Conditional& conditional = conditionals.back();
+            conditional.active = conditional.parentActive && !(conditional.known && conditional.taken);
+            conditional.known = conditional.known && conditional.taken;
+        } else if (keyword == "else") {
+            Conditional& conditional = conditionals.back();
+            conditional.active = conditional.parentActive && !(conditional.known && conditional.taken);
+        } else if (keyword == "endif") {
+            conditionals.pop_back();
+        }
+    }
+
+    std::string Shader::injectDefines(const std::string& source) {
+
+        if (defines.empty()) {
+            return source;
+        }
+
+        std::string defineLines;
+        for (const std::string& define : defines) {
+            defineLines += "#define " + define + "\n";
+        }
+
+        //#version has to stay the first statement, #line undoes the shift the
+        //defines cause so errors still report lines of the stage file, index 0
+        size_t version = source.find("#version");
+        if (version == std::string::npos) {
+            return defineLines + "#line 1 0\n" + source;
+        }
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return source + "\n" + defineLines;
+        }
+        int nextLine = (int)std::count(source.begin(), source.begin() + lineEnd + 1, '\n') + 1;
+        return source.substr(0, lineEnd + 1) + defineLines + "#line " + std::to_string(nextLine) + " 0\n"
+               + source.substr(lineEnd + 1);
+    }
+
+    bool Shader::shaderCompileLog(GLuint shaderId) {
 
         GLint success;
         GLchar infoLog[512];
@@ -43,9 +158,10 @@ namespace gps {
             glGetShaderInfoLog(shaderId, 512, NULL, infoLog);
             std::cout << "Shader compilation error\n" << infoLog << std::endl;
         }
+        return success;
     }
     
-    void Shader::shaderLinkLog(GLuint shaderProgramId) {
+    bool Shader::shaderLinkLog(GLuint shaderProgramId) {
 
         GLint success;
         GLchar infoLog[512];
@@ -53,44 +169,312 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success;
     }
-    
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
-
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-        
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-        
+
+    GLuint Shader::compileShader(GLenum type, const std::string& source) {
+
+        //the status is checked in finishLoad, querying it here would wait for the compiler
+        const GLchar* shaderString = source.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &shaderString, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    void Shader::beginProgram(const std::vector<ShaderStage>& stages, const std::vector<std::string>& varyings) {
+
+        //remembered so the program can be rebuilt when a source file changes
+        this->stages = stages;
+        this->varyings = varyings;
+
+        //read every stage up front with its includes resolved, the expanded sources are the
+        //cache key, so editing a shared include invalidates exactly the programs using it;
+        //includes under an #ifdef the variant's defines rule out are not counted as used
+        std::vector<std::string> sources;
+        std::vector<std::vector<std::string>> stageFiles;
+        for (const ShaderStage& stage : stages) {
+            std::vector<std::string> includedFiles;
+            sources.push_back(injectDefines(preprocessShaderFile(stage.fileName, includedFiles)));
+            stageFiles.push_back(includedFiles);
+        }
+
+        sourceFiles.clear();
+        for (const std::vector<std::string>& includedFiles : stageFiles) {
+            for (const std::string& file : includedFiles) {
+                if (std::find(sourceFiles.begin(), sourceFiles.end(), file) == sourceFiles.end()) {
+                    sourceFiles.push_back(file);
+                }
+            }
+        }
+
+        discardPendingLoad();
+        pendingCacheKey = programCacheKey(sources, varyings);
+        pendingProgram = loadProgramBinary(pendingCacheKey);
+        if (pendingProgram != 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            pendingShaders.push_back(compileShader(stages[i].type, sources[i]));
+        }
+        pendingStageFiles = stageFiles;
+
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+        pendingProgram = glCreateProgram();
+        for (GLuint shader : pendingShaders) {
+            glAttachShader(pendingProgram, shader);
+        }
+
+        //the captured outputs have to be declared before linking
+        if (!varyings.empty()) {
+            std::vector<const GLchar*> varyingNames;
+            for (const std::string& varying : varyings) {
+                varyingNames.push_back(varying.c_str());
+            }
+            glTransformFeedbackVaryings(pendingProgram, (GLsizei)varyingNames.size(),
+                                        varyingNames.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+
+        if (!binaryCacheDirectory.empty()) {
+            glProgramParameteri(pendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(pendingProgram);
+        pendingLink = true;
+    }
+
+    void Shader::discardPendingLoad() {
+
+        for (GLuint shader : pendingShaders) {
+            glDeleteShader(shader);
+        }
+        pendingShaders.clear();
+        pendingStageFiles.clear();
+        if (pendingProgram != 0) {
+            glDeleteProgram(pendingProgram);
+            pendingProgram = 0;
+        }
+        pendingLink = false;
+    }
+
+    bool Shader::isLoadComplete() {
+
+        if (!pendingLink) {
+            return true;
+        }
+#if not defined (__APPLE__)
+        if (parallelCompile) {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &complete);
+            return complete;
+        }
+#endif
+        return true;
+    }
+
+    bool Shader::finishLoad() {
+
+        if (pendingProgram == 0) {
+            return true;
+        }
+
+        if (pendingLink) {
+            //check compilation status of every stage, then the link
+            for (size_t i = 0; i < pendingShaders.size(); i++) {
+                if (!shaderCompileLog(pendingShaders[i])) {
+                    //the log reports positions as source-index(line)
+                    for (size_t file = 0; file < pendingStageFiles[i].size(); file++) {
+                        std::cout << "  " << file << ": " << pendingStageFiles[i][file] << std::endl;
+                    }
+                }
+                glDeleteShader(pendingShaders[i]);
+            }
+            pendingShaders.clear();
+            pendingStageFiles.clear();
+            pendingLink = false;
+
+            //check linking info, a failed program never replaces a working one
+            if (!shaderLinkLog(pendingProgram)) {
+                glDeleteProgram(pendingProgram);
+                pendingProgram = 0;
+                return false;
+            }
+            saveProgramBinary(pendingCacheKey, pendingProgram);
+        }
+
+        if (this->shaderProgram != 0) {
+            glDeleteProgram(this->shaderProgram);
+        }
+        this->shaderProgram = pendingProgram;
+        pendingProgram = 0;
+        return true;
+    }
+
+    void Shader::beginReload() {
+
+        if (!stages.empty()) {
+            beginProgram(stages, varyings);
+        }
+    }
+
+    void Shader::enableParallelCompile() {
+
+#if not defined (__APPLE__)
+        //0xFFFFFFFF leaves the thread count to the implementation
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompile = true;
+        } else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+#endif
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                            const std::vector<std::string>& defines) {
+
+        beginLoadShader(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
     }
     
+    void Shader::loadFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings) {
+
+        loadFeedbackShader(vertexShaderFileName, "", varyings);
+    }
+
+    void Shader::loadFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+                                    const std::vector<std::string>& varyings) {
+
+        beginLoadFeedbackShader(vertexShaderFileName, geometryShaderFileName, varyings);
+        finishLoad();
+    }
+
+    void Shader::beginLoadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                                 const std::vector<std::string>& defines) {
+
+        this->defines = defines;
+        beginProgram({ { GL_VERTEX_SHADER, vertexShaderFileName },
+                       { GL_FRAGMENT_SHADER, fragmentShaderFileName } }, {});
+    }
+
+    void Shader::beginLoadFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings) {
+
+        beginLoadFeedbackShader(vertexShaderFileName, "", varyings);
+    }
+
+    void Shader::beginLoadFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+                                         const std::vector<std::string>& varyings) {
+
+        //program without fragment stage, the geometry shader is optional
+        this->defines.clear();
+        std::vector<ShaderStage> stages = { { GL_VERTEX_SHADER, vertexShaderFileName } };
+        if (!geometryShaderFileName.empty()) {
+            stages.push_back({ GL_GEOMETRY_SHADER, geometryShaderFileName });
+        }
+        beginProgram(stages, varyings);
+    }
+
+    std::string Shader::programCacheKey(const std::vector<std::string>& sources,
+                                        const std::vector<std::string>& varyings) {
+
+        //FNV-1a over everything that changes the binary: sources, captured varyings and the driver
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&hash](const std::string& text) {
+            for (unsigned char c : text) {
+                hash = (hash ^ c) * 1099511628211ULL;
+            }
+            hash = (hash ^ 0xFF) * 1099511628211ULL;
+        };
+        for (const std::string& source : sources) {
+            mix(source);
+        }
+        for (const std::string& varying : varyings) {
+            mix(varying);
+        }
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const GLubyte* value = glGetString(name);
+            mix(value ? reinterpret_cast<const char*>(value) : "");
+        }
+
+        std::stringstream key;
+        key << std::hex << hash;
+        return key.str();
+    }
+
+    std::string Shader::programCachePath(const std::string& cacheKey) {
+
+        return binaryCacheDirectory + "/" + cacheKey + ".bin";
+    }
+
+    GLuint Shader::loadProgramBinary(const std::string& cacheKey) {
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (binaryCacheDirectory.empty() || formatCount == 0) {
+            return 0;
+        }
+
+        std::ifstream file(programCachePath(cacheKey), std::ios::binary);
+        if (!file.is_open()) {
+            return 0;
+        }
+
+        GLenum binaryFormat;
+        GLint length;
+        if (!file.read(reinterpret_cast<char*>(&binaryFormat), sizeof(binaryFormat)) ||
+            !file.read(reinterpret_cast<char*>(&length), sizeof(length)) || length <= 0) {
+            return 0;
+        }
+        std::vector<char> binary(length);
+        if (!file.read(binary.data(), length)) {
+            return 0;
+        }
+
+        //the driver may still reject it (e.g. after an update), then we silently compile
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, binaryFormat, binary.data(), length);
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            return 0;
+        }
+
+        return program;
+    }
+
+    void Shader::saveProgramBinary(const std::string& cacheKey, GLuint program) {
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (binaryCacheDirectory.empty() || formatCount == 0) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> binary(length);
+        GLenum binaryFormat;
+        glGetProgramBinary(program, length, NULL, &binaryFormat, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(binaryCacheDirectory, error);
+        std::ofstream file(programCachePath(cacheKey), std::ios::binary);
+        if (!file.is_open()) {
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&binaryFormat), sizeof(binaryFormat));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(binary.data(), length);
+    }
+
     void Shader::useShaderProgram() {
 
         glUseProgram(this->shaderProgram);
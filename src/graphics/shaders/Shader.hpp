@@ -19,6 +19,8 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 namespace gps {
@@ -26,14 +28,84 @@ namespace gps {
     class Shader {
 
     public:
-        GLuint shaderProgram;
-        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+        GLuint shaderProgram = 0;
+        // each define is inserted as "#define NAME" right after the #version line of every stage
+        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                        const std::vector<std::string>& defines = {});
+        // program without fragment stage whose outputs are captured with transform feedback,
+        // the geometry shader is optional
+        void loadFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings);
+        void loadFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+                                const std::vector<std::string>& varyings);
         void useShaderProgram();
+
+        // split loading: begin* submits compile and link without waiting on the driver,
+        // finishLoad checks the results, so several programs can compile in parallel
+        void beginLoadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                             const std::vector<std::string>& defines = {});
+        void beginLoadFeedbackShader(std::string vertexShaderFileName, const std::vector<std::string>& varyings);
+        void beginLoadFeedbackShader(std::string vertexShaderFileName, std::string geometryShaderFileName,
+                                     const std::vector<std::string>& varyings);
+        // swaps the new program in once it linked, on failure the previous one stays in use
+        bool finishLoad();
+        // true once finishLoad will not stall, always true without KHR_parallel_shader_compile
+        bool isLoadComplete();
+        bool hasPendingLoad() const { return pendingProgram != 0; }
+
+        // rebuilds from the files of the last load, finish it like any other load
+        void beginReload();
+        // stage files and everything they #include, as of the last load
+        const std::vector<std::string>& getSourceFiles() const { return sourceFiles; }
+        // lets the driver use its own compiler threads, when KHR/ARB_parallel_shader_compile is available
+        static void enableParallelCompile();
+
+        // linked programs are cached here as driver binaries, keyed by their sources and
+        // the GL renderer/version; an empty directory disables the cache
+        static void setBinaryCacheDirectory(const std::string& directory) { binaryCacheDirectory = directory; }
     
     private:
+        struct ShaderStage {
+            GLenum type;
+            std::string fileName;
+        };
+
+        struct Conditional {
+            bool parentActive;
+            bool active;        // lines here reach the compiler
+            bool taken;         // an earlier branch of this #ifdef was active
+            bool known;         // false once an #if or #elif expression is involved
+        };
+
+        static std::string binaryCacheDirectory;
+        static bool parallelCompile;
+
+        std::vector<ShaderStage> stages;
+        std::vector<std::string> varyings;
+        std::vector<std::string> defines;
+        std::vector<std::string> sourceFiles;
+
+        GLuint pendingProgram = 0;      // built next to shaderProgram until finishLoad
+        std::vector<GLuint> pendingShaders;
+        std::vector<std::vector<std::string>> pendingStageFiles;    // source string index -> file
+        std::string pendingCacheKey;
+        bool pendingLink = false;
+
         std::string readShaderFile(std::string fileName);
-        void shaderCompileLog(GLuint shaderId);
-        void shaderLinkLog(GLuint shaderProgramId);
+        // resolves #include "file" recursively, recording every file read in includedFiles
+        std::string preprocessShaderFile(const std::string& fileName, std::vector<std::string>& includedFiles);
+        // follows #ifdef/#ifndef/#else/#endif against the defines, for the includes inside them
+        void trackConditional(const std::string& directive, std::vector<Conditional>& conditionals);
+        std::string injectDefines(const std::string& source);
+        bool shaderCompileLog(GLuint shaderId);
+        bool shaderLinkLog(GLuint shaderProgramId);
+        void beginProgram(const std::vector<ShaderStage>& stages, const std::vector<std::string>& varyings);
+        GLuint compileShader(GLenum type, const std::string& source);
+        void discardPendingLoad();
+
+        std::string programCacheKey(const std::vector<std::string>& sources, const std::vector<std::string>& varyings);
+        std::string programCachePath(const std::string& cacheKey);
+        GLuint loadProgramBinary(const std::string& cacheKey);
+        void saveProgramBinary(const std::string& cacheKey, GLuint program);
     };
     
 }
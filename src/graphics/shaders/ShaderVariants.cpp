@@ -0,0 +1,83 @@
+#include "ShaderVariants.hpp"
+
+namespace gps {
+
+    void ShaderVariants::setSources(const std::string& vertexShaderFileName,
+                                    const std::string& fragmentShaderFileName) {
+
+        this->vertexShaderFileName = vertexShaderFileName;
+        this->fragmentShaderFileName = fragmentShaderFileName;
+    }
+
+    void ShaderVariants::prepare(const std::vector<unsigned>& featureSets) {
+
+        for (unsigned features : featureSets) {
+            features = normalize(features);
+            if (variants.count(features) == 0) {
+                variants[features].beginLoadShader(vertexShaderFileName, fragmentShaderFileName,
+                                                   getDefines(features));
+            }
+        }
+    }
+
+    Shader& ShaderVariants::get(unsigned features) {
+
+        features = normalize(features);
+        auto variant = variants.find(features);
+        if (variant == variants.end()) {
+            std::cout << "Compiling shader variant " << features << " on first use" << std::endl;
+            variant = variants.emplace(features, Shader()).first;
+            variant->second.beginLoadShader(vertexShaderFileName, fragmentShaderFileName, getDefines(features));
+        }
+
+        //a prepared variant nobody finished yet, a pending hot reload is left alone
+        Shader& shader = variant->second;
+        if (shader.shaderProgram == 0 && shader.hasPendingLoad()) {
+            if (shader.finishLoad() && buildCallback) {
+                shader.useShaderProgram();
+                buildCallback(shader);
+            }
+        }
+        return shader;
+    }
+
+    void ShaderVariants::forEach(const std::function<void(Shader&)>& function) {
+
+        for (auto& variant : variants) {
+            if (variant.second.shaderProgram != 0) {
+                variant.second.useShaderProgram();
+                function(variant.second);
+            }
+        }
+    }
+
+    std::vector<Shader*> ShaderVariants::getShaders() {
+
+        std::vector<Shader*> shaders;
+        for (auto& variant : variants) {
+            shaders.push_back(&variant.second);
+        }
+        return shaders;
+    }
+
+    unsigned ShaderVariants::normalize(unsigned features) {
+
+        //the dome only ever samples its texture
+        if (features & SKYDOME) {
+            return features & (SKYDOME | DIFFUSE_MAP);
+        }
+        return features;
+    }
+
+    std::vector<std::string> ShaderVariants::getDefines(unsigned features) {
+
+        std::vector<std::string> defines;
+        if (features & SHADOWS) defines.push_back("SHADOWS");
+        if (features & FOG) defines.push_back("FOG");
+        if (features & DIFFUSE_MAP) defines.push_back("DIFFUSE_MAP");
+        if (features & SPECULAR_MAP) defines.push_back("SPECULAR_MAP");
+        if (features & SKYDOME) defines.push_back("SKYDOME");
+        return defines;
+    }
+
+}
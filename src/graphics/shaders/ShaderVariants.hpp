@@ -0,0 +1,50 @@
+#ifndef ShaderVariants_hpp
+#define ShaderVariants_hpp
+
+#include "Shader.hpp"
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // One vertex/fragment pair compiled once per feature combination. Every
+    // feature bit becomes a #define of the same name, so a variant only pays for
+    // the lighting, shadow, fog and texture work the mesh drawn with it needs.
+    class ShaderVariants {
+
+    public:
+        static const unsigned SHADOWS = 1 << 0;
+        static const unsigned FOG = 1 << 1;
+        static const unsigned DIFFUSE_MAP = 1 << 2;
+        static const unsigned SPECULAR_MAP = 1 << 3;
+        static const unsigned SKYDOME = 1 << 4;     // unlit backdrop, ignores the other scene features
+
+        void setSources(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+
+        // submits the combinations known up front, finish them with the other shaders
+        void prepare(const std::vector<unsigned>& featureSets);
+        // variants that were not prepared are compiled on first use
+        Shader& get(unsigned features);
+
+        // binds every built variant in turn, for uniforms all of them share
+        void forEach(const std::function<void(Shader&)>& function);
+        // called, bound, for a variant get() had to finish itself; it missed the
+        // last forEach and is not known to anything holding getShaders()
+        void setBuildCallback(const std::function<void(Shader&)>& callback) { buildCallback = callback; }
+        std::vector<Shader*> getShaders();
+
+    private:
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        std::map<unsigned, Shader> variants;    // node based, so Shader pointers stay valid
+        std::function<void(Shader&)> buildCallback;
+
+        static unsigned normalize(unsigned features);
+        static std::vector<std::string> getDefines(unsigned features);
+    };
+
+}
+
+#endif /* ShaderVariants_hpp */
@@ -0,0 +1,188 @@
+#include "ShaderWatcher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+
+#if defined (__linux__)
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+namespace gps {
+
+    ShaderWatcher::~ShaderWatcher() {
+
+        stop();
+    }
+
+    void ShaderWatcher::watch(Shader* shader) {
+
+        if (std::find(shaders.begin(), shaders.end(), shader) != shaders.end()) {
+            return;
+        }
+        shaders.push_back(shader);
+        refreshFiles();
+    }
+
+    void ShaderWatcher::start() {
+
+        if (running || shaders.empty()) {
+            return;
+        }
+        running = true;
+        thread = std::thread([this]() {
+            if (!watchWithInotify()) {
+                watchWithPolling();
+            }
+        });
+    }
+
+    void ShaderWatcher::stop() {
+
+        running = false;
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    void ShaderWatcher::refreshFiles() {
+
+        std::vector<std::string> allFiles;
+        for (Shader* shader : shaders) {
+            for (const std::string& file : shader->getSourceFiles()) {
+                if (std::find(allFiles.begin(), allFiles.end(), file) == allFiles.end()) {
+                    allFiles.push_back(file);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(filesMutex);
+        if (allFiles != files) {
+            files = allFiles;
+            filesChanged = true;
+        }
+    }
+
+    std::vector<Shader*> ShaderWatcher::takeChangedShaders() {
+
+        std::vector<std::string> changed;
+        {
+            std::lock_guard<std::mutex> lock(changedMutex);
+            changed.swap(changedFiles);
+        }
+
+        //the reverse of each shader's include list, so a shared file rebuilds all its users
+        std::vector<Shader*> changedShaders;
+        for (Shader* shader : shaders) {
+            const std::vector<std::string>& sourceFiles = shader->getSourceFiles();
+            for (const std::string& file : changed) {
+                if (std::find(sourceFiles.begin(), sourceFiles.end(), file) != sourceFiles.end()) {
+                    changedShaders.push_back(shader);
+                    break;
+                }
+            }
+        }
+        return changedShaders;
+    }
+
+    bool ShaderWatcher::takeFiles(std::vector<std::string>& watchedFiles) {
+
+        std::lock_guard<std::mutex> lock(filesMutex);
+        if (!filesChanged) {
+            return false;
+        }
+        watchedFiles = files;
+        filesChanged = false;
+        return true;
+    }
+
+    void ShaderWatcher::markChanged(const std::string& file) {
+
+        std::cout << "Shader source changed: " << file << std::endl;
+        std::lock_guard<std::mutex> lock(changedMutex);
+        if (std::find(changedFiles.begin(), changedFiles.end(), file) == changedFiles.end()) {
+            changedFiles.push_back(file);
+        }
+    }
+
+    bool ShaderWatcher::watchWithInotify() {
+
+#if defined (__linux__)
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        //editors often save by writing a new file and renaming it over the old one,
+        //so the directories are watched rather than the files themselves
+        std::vector<std::string> watchedFiles;
+        std::map<int, std::filesystem::path> directories;
+        alignas(inotify_event) char buffer[4096];
+        while (running) {
+            if (takeFiles(watchedFiles)) {
+                for (const std::string& file : watchedFiles) {
+                    std::filesystem::path directory = std::filesystem::path(file).parent_path();
+                    int wd = inotify_add_watch(fd, directory.empty() ? "." : directory.c_str(),
+                                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                    if (wd >= 0) {
+                        directories[wd] = directory;
+                    }
+                }
+            }
+
+            //wake up regularly so stop() and new files are not held up by a quiet directory
+            pollfd descriptor = { fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, POLL_INTERVAL_MS) <= 0) {
+                continue;
+            }
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length; ) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (event->len == 0) {
+                    continue;
+                }
+                std::string changed = (directories[event->wd] / event->name).generic_string();
+                if (std::find(watchedFiles.begin(), watchedFiles.end(), changed) != watchedFiles.end()) {
+                    markChanged(changed);
+                }
+            }
+        }
+
+        close(fd);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void ShaderWatcher::watchWithPolling() {
+
+        std::vector<std::string> watchedFiles;
+        std::map<std::string, std::filesystem::file_time_type> lastWrites;
+        while (running) {
+            if (takeFiles(watchedFiles)) {
+                for (const std::string& file : watchedFiles) {
+                    if (lastWrites.count(file) == 0) {
+                        std::error_code error;
+                        lastWrites[file] = std::filesystem::last_write_time(file, error);
+                    }
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+            for (const std::string& file : watchedFiles) {
+                std::error_code error;
+                std::filesystem::file_time_type lastWrite = std::filesystem::last_write_time(file, error);
+                if (!error && lastWrite != lastWrites[file]) {
+                    lastWrites[file] = lastWrite;
+                    markChanged(file);
+                }
+            }
+        }
+    }
+
+}
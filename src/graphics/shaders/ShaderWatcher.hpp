@@ -0,0 +1,56 @@
+#ifndef ShaderWatcher_hpp
+#define ShaderWatcher_hpp
+
+#include "Shader.hpp"
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Watches the source files of a set of shaders, includes too, on a background
+    // thread (inotify on Linux, modification times elsewhere) and reports which
+    // shaders need rebuilding. The rebuild itself stays on the GL thread: collect
+    // the changed shaders once per frame, beginReload them and finishLoad when ready.
+    class ShaderWatcher {
+
+    public:
+        ~ShaderWatcher();
+
+        // safe while running, a shader already watched is ignored
+        void watch(Shader* shader);
+        void start();
+        void stop();
+        // call after a rebuild, the shader may include different files now
+        void refreshFiles();
+
+        // shaders depending on a file that changed since the last call, each listed once
+        std::vector<Shader*> takeChangedShaders();
+
+    private:
+        static constexpr int POLL_INTERVAL_MS = 250;
+
+        std::vector<Shader*> shaders;
+        std::thread thread;
+        std::atomic<bool> running{false};
+
+        // written by the GL thread, copied by the watcher thread when filesChanged is set
+        std::mutex filesMutex;
+        std::vector<std::string> files;
+        bool filesChanged = false;
+
+        std::mutex changedMutex;
+        std::vector<std::string> changedFiles;
+
+        bool takeFiles(std::vector<std::string>& watchedFiles);
+        void markChanged(const std::string& file);
+        bool watchWithInotify();
+        void watchWithPolling();
+    };
+
+}
+
+#endif /* ShaderWatcher_hpp */
@@ -1,16 +1,17 @@
 #include "Controls.hpp"
+#include "InputRecorder.hpp"
+#include "../core/TraceProfiler.hpp"
 #include <iostream>
 #include <iomanip>
 
 Controls* Controls::instance = nullptr;
 
 Controls::Controls(GLFWwindow* window, gps::Camera& camera, std::vector<Pokemon*>& pokemons, 
-                  Rain* rainSystem, AudioManager& audioManager, gps::Shader& customShader, 
-                  gps::Shader& lightShader, GLuint& projLoc, glm::vec3& lightDir)
+                  Rain* rainSystem, AudioManager& audioManager,
+                  gps::Shader& lightShader, glm::vec3& lightDir)
     : window(window), camera(camera), pokemons(pokemons), 
       rainSystem(rainSystem), audioManager(audioManager),
-      myCustomShader(customShader), lightShader(lightShader),
-      projectionLoc(projLoc), lightDir(lightDir) {
+      lightShader(lightShader), lightDir(lightDir) {
     
     instance = this;
     
@@ -24,6 +25,12 @@ Controls::Controls(GLFWwindow* window, gps::Camera& camera, std::vector<Pokemon*
     lightAngle = 0.0f;
     keyUPressed = false;
     keyRPressed = false;
+    keyGPressed = false;
+    keyFPressed = false;
+    keyPPressed = false;
+    timingDumpRequested = false;
+    recorder = nullptr;
+    liveInputEnabled = true;
     firstMouse = true;
     lastX = 800.0f / 2.0f;
     lastY = 600.0f / 2.0f;
@@ -40,7 +47,8 @@ Controls::Controls(GLFWwindow* window, gps::Camera& camera, std::vector<Pokemon*
     rainSoundPlaying = false;
     spinSoundPlaying = false;
     
-    if (!audioManager.loadSound("sounds/rain.wav", rainBuffer)) {
+    rainStream = nullptr;
+    if (!audioManager.openStream("sounds/rain.wav", rainStream)) {
         std::cerr << "Failed to load rain sound" << std::endl;
     }
     if (!audioManager.loadSound("sounds/oiia_cat.wav", spinSoundBuffer)) {
@@ -48,12 +56,16 @@ Controls::Controls(GLFWwindow* window, gps::Camera& camera, std::vector<Pokemon*
     }
 
     showDepthMap = false;
+    debugCascade = 0;
+    shadowFilterMode = SHADOW_FILTER_POISSON;
     
     // Initialize presentation mode
     presentationMode = false;
     presentationAngle = 0.0f;
     presentationRadius = INITIAL_RADIUS;
     presentationCenter = glm::vec3(0.0f, 0.0f, 0.0f);
+    cameraPath = nullptr;
+    presentationTime = 0.0f;
 }
 
 void Controls::setupCallbacks() {
@@ -69,64 +81,100 @@ void Controls::keyCallback(GLFWwindow* window, int key, int scancode, int action
         if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
             glfwSetWindowShouldClose(window, GL_TRUE);
 
-        if (key >= 0 && key < 1024) {
-            if (action == GLFW_PRESS)
-                instance->pressedKeys[key] = true;
-            else if (action == GLFW_RELEASE)
-                instance->pressedKeys[key] = false;
-        }
+        if (!instance->acceptsLiveInput()) return;
+        if (instance->recorder) instance->recorder->recordKey(key, action);
+        instance->handleKey(key, action);
     }
 }
 
 void Controls::mouseCallback(GLFWwindow* window, double xpos, double ypos) {
-    if (!instance || !instance->cursorLocked) return;
+    if (!instance || !instance->acceptsLiveInput()) return;
+    if (instance->recorder) instance->recorder->recordCursorPos(xpos, ypos);
+    instance->handleCursorPos(xpos, ypos);
+}
+
+void Controls::mouseButtonCallback(GLFWwindow* /*window*/, int button, int action, int mods) {
+    if (!instance || !instance->acceptsLiveInput()) return;
+    if (instance->recorder) instance->recorder->recordMouseButton(button, action);
+    instance->handleMouseButton(button, action);
+}
+
+void Controls::scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+    if (!instance || !instance->acceptsLiveInput()) return;
+    if (instance->recorder) instance->recorder->recordScroll(xoffset, yoffset);
+    instance->handleScroll(xoffset, yoffset);
+}
+
+bool Controls::acceptsLiveInput() const {
+    // during a replay or a benchmark only the recording or the path drives the scene
+    return liveInputEnabled && !(recorder && recorder->isReplaying());
+}
+
+void Controls::handleKey(int key, int action) {
+    if (key >= 0 && key < 1024) {
+        if (action == GLFW_PRESS)
+            pressedKeys[key] = true;
+        else if (action == GLFW_RELEASE)
+            pressedKeys[key] = false;
+    }
+}
+
+void Controls::handleCursorPos(double xpos, double ypos) {
+    if (!cursorLocked) return;
     
-    if (instance->firstMouse) {
-        instance->lastX = xpos;
-        instance->lastY = ypos;
-        instance->firstMouse = false;
+    if (firstMouse) {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
         return;
     }
 
-    float xoffset = xpos - instance->lastX;
-    float yoffset = instance->lastY - ypos;
-    instance->lastX = xpos;
-    instance->lastY = ypos;
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos;
+    lastX = xpos;
+    lastY = ypos;
 
     const float sensitivity = 0.1f;
     xoffset *= sensitivity;
     yoffset *= sensitivity;
 
-    instance->yaw += xoffset;
-    instance->pitch += yoffset;
+    yaw += xoffset;
+    pitch += yoffset;
 
-    if (instance->pitch > 89.0f) instance->pitch = 89.0f;
-    if (instance->pitch < -89.0f) instance->pitch = -89.0f;
+    if (pitch > 89.0f) pitch = 89.0f;
+    if (pitch < -89.0f) pitch = -89.0f;
 
-    instance->camera.rotate(instance->pitch, instance->yaw);
+    camera.rotate(pitch, yaw);
 }
 
-void Controls::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
-    if (instance && button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
-        instance->cursorLocked = !instance->cursorLocked;
+void Controls::handleMouseButton(int button, int action) {
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
+        cursorLocked = !cursorLocked;
         
-        if (instance->cursorLocked) {
+        if (cursorLocked) {
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-            instance->firstMouse = true;
+            firstMouse = true;
         } else {
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
         }
     }
 }
 
-void Controls::scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
-    if (instance) {
-        float zoomSpeed = 1.0f;
-        instance->camera.zoom(yoffset * zoomSpeed);
-        
-        instance->updateProjectionMatrix(instance->myCustomShader, instance->projectionLoc);
-        instance->updateProjectionMatrix(instance->lightShader, 
-            glGetUniformLocation(instance->lightShader.shaderProgram, "projection"));
+void Controls::handleScroll(double xoffset, double yoffset) {
+    float zoomSpeed = 1.0f;
+    camera.zoom(yoffset * zoomSpeed);
+    
+    // the scene shaders pick the camera projection up every frame
+    updateProjectionMatrix(lightShader, 
+        glGetUniformLocation(lightShader.shaderProgram, "projection"));
+}
+
+void Controls::playSpinSounds() {
+    // each spinning Pokemon is its own emitter, the far ones stay virtual
+    for (auto pokemon : pokemons) {
+        if (pokemon->isSpinning()) {
+            spinVoices.push_back(pokemon->emitSound(audioManager, spinSoundBuffer, true));
+        }
     }
 }
 
@@ -148,7 +196,25 @@ void Controls::printWindInfo() {
               << " Strength: " << windStrength << std::endl;
 }
 
-void Controls::processMovement() {
+void Controls::startPresentation() {
+    presentationMode = true;
+    presentationAngle = 0.0f;
+    presentationRadius = INITIAL_RADIUS;
+    presentationTime = 0.0f;
+    std::cout << "Presentation mode enabled" << std::endl;
+}
+
+void Controls::setWind(float angleDegrees, float strength) {
+    windEnabled = true;
+    currentWindAngle = glm::clamp(angleDegrees, MIN_WIND_ANGLE, MAX_WIND_ANGLE);
+    windDirection = glm::normalize(glm::vec3(cos(glm::radians(currentWindAngle)), 0.0f,
+                                             sin(glm::radians(currentWindAngle))));
+    windStrength = strength;
+    printWindInfo();
+}
+
+void Controls::processMovement(float deltaTime) {
+    TRACE_ZONE("Controls::processMovement");
     static bool wireframeMode = false;
     static bool pointMode = false;
 
@@ -181,7 +247,7 @@ void Controls::processMovement() {
             if (pokemon->isSpinning()) anyPokemonSpinning = true;
         }
         if (anyPokemonSpinning && !spinSoundPlaying) {
-            audioManager.playSound(spinSoundBuffer, true);
+            playSpinSounds();
             spinSoundPlaying = true;
         }
     } else if (pressedKeys[GLFW_KEY_E]) {
@@ -192,7 +258,7 @@ void Controls::processMovement() {
             if (pokemon->isSpinning()) anyPokemonSpinning = true;
         }
         if (anyPokemonSpinning && !spinSoundPlaying) {
-            audioManager.playSound(spinSoundBuffer, true);
+            playSpinSounds();
             spinSoundPlaying = true;
         }
     } else {
@@ -200,24 +266,39 @@ void Controls::processMovement() {
             pokemon->stopJumping();
         }
         if (spinSoundPlaying) {
-            audioManager.stopSound();
+            for (VoiceHandle voice : spinVoices) {
+                audioManager.stopSound(voice);
+            }
+            spinVoices.clear();
             spinSoundPlaying = false;
         }
     }
 
     // Scene presentation mode
     if (pressedKeys[GLFW_KEY_T]) {
-        presentationMode = !presentationMode;
         pressedKeys[GLFW_KEY_T] = false;
         
-        if (presentationMode) {
-            std::cout << "Presentation mode enabled" << std::endl;
+        if (!presentationMode) {
+            startPresentation();
         } else {
+            presentationMode = false;
             std::cout << "Presentation mode disabled" << std::endl;
         }
     }
     
-    if (presentationMode) {
+    if (presentationMode && cameraPath && cameraPath->isLoaded()) {
+        glm::vec3 position;
+        glm::vec3 target;
+        cameraPath->sample(presentationTime, position, target);
+        camera.setPosition(position);
+        camera.lookAt(target);
+
+        presentationTime += deltaTime;
+        if (presentationTime > cameraPath->getDuration()) {
+            presentationMode = false;
+            std::cout << "Presentation complete" << std::endl;
+        }
+    } else if (presentationMode) {
         float progress = (presentationRadius - FINAL_RADIUS) / (INITIAL_RADIUS - FINAL_RADIUS);
         float currentHeight = FINAL_HEIGHT + (INITIAL_HEIGHT - FINAL_HEIGHT) * progress;
         
@@ -320,11 +401,11 @@ void Controls::processMovement() {
         keyRPressed = true;
         
         if (!wasEnabled && rainSystem->isEnabled()) {
-            audioManager.playSound(rainBuffer, true);
+            audioManager.playStream(rainStream, true);
             rainSoundPlaying = true;
             std::cout << "Rain enabled" << std::endl;
         } else if (wasEnabled && !rainSystem->isEnabled()) {
-            audioManager.stopSound();
+            audioManager.stopStream(rainStream);
             rainSoundPlaying = false;
             std::cout << "Rain disabled" << std::endl;
         }
@@ -333,11 +414,50 @@ void Controls::processMovement() {
         keyRPressed = false;
     }
 
+    if (pressedKeys[GLFW_KEY_G] && !keyGPressed) {
+        rainSystem->toggleBackend();
+        keyGPressed = true;
+        std::cout << "Rain simulation on "
+                  << (rainSystem->getBackend() == Rain::Backend::GPU ? "GPU" : "CPU") << std::endl;
+    }
+    if (!pressedKeys[GLFW_KEY_G]) {
+        keyGPressed = false;
+    }
+
+    if (pressedKeys[GLFW_KEY_F] && !keyFPressed) {
+        shadowFilterMode = (shadowFilterMode + 1) % 3;
+        keyFPressed = true;
+        const char* filterNames[] = { "hardware 2x2", "grid PCF", "rotated Poisson PCF" };
+        std::cout << "Shadow filtering: " << filterNames[shadowFilterMode] << std::endl;
+    }
+    if (!pressedKeys[GLFW_KEY_F]) {
+        keyFPressed = false;
+    }
+
+    if (pressedKeys[GLFW_KEY_P] && !keyPPressed) {
+        timingDumpRequested = true;
+        keyPPressed = true;
+    }
+    if (!pressedKeys[GLFW_KEY_P]) {
+        keyPPressed = false;
+    }
+
     // Depth map toggle
     if (pressedKeys[GLFW_KEY_M]) {
         showDepthMap = !showDepthMap;
         pressedKeys[GLFW_KEY_M] = false;  
     }
+    // next cascade in the depth map view, wrapped by the engine
+    if (pressedKeys[GLFW_KEY_N]) {
+        debugCascade++;
+        pressedKeys[GLFW_KEY_N] = false;
+    }
+}
+
+bool Controls::consumeTimingDumpRequest() {
+    bool requested = timingDumpRequested;
+    timingDumpRequested = false;
+    return requested;
 }
 
 glm::mat4 Controls::getProjectionMatrix() const {
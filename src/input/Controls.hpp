@@ -5,24 +5,44 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "../camera/Camera.hpp"
+#include "../camera/CameraPath.hpp"
 #include "../entities/Pokemon.hpp"
 #include "../graphics/effects/Rain.hpp"
 #include "../audio/AudioManager.hpp"
 #include <vector>
 
+class InputRecorder;
+
 class Controls {
 public:
     Controls(GLFWwindow* window, gps::Camera& camera, std::vector<Pokemon*>& pokemons, 
-             Rain* rainSystem, AudioManager& audioManager, gps::Shader& customShader, 
-             gps::Shader& lightShader, GLuint& projLoc, glm::vec3& lightDir);
+             Rain* rainSystem, AudioManager& audioManager,
+             gps::Shader& lightShader, glm::vec3& lightDir);
     
-    void processMovement();
+    // deltaTime only drives the camera path, everything else steps per frame
+    void processMovement(float deltaTime = 1.0f / 60.0f);
     void setupCallbacks();
     
     static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
     static void mouseCallback(GLFWwindow* window, double xpos, double ypos);
     static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
     static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+
+    // input handlers behind the GLFW callbacks, also driven by InputRecorder replays
+    void handleKey(int key, int action);
+    void handleCursorPos(double xpos, double ypos);
+    void handleMouseButton(int button, int action);
+    void handleScroll(double xoffset, double yoffset);
+    // live events are recorded into it, or ignored while it replays
+    void setRecorder(InputRecorder* recorder) { this->recorder = recorder; }
+    void setLiveInputEnabled(bool enabled) { liveInputEnabled = enabled; }
+
+    // presentation mode (T) follows this path when set, otherwise the built-in orbit
+    void setCameraPath(const gps::CameraPath* path) { cameraPath = path; }
+    void startPresentation();
+    bool isPresenting() const { return presentationMode; }
+    float getPresentationTime() const { return presentationTime; }
+    void setWind(float angleDegrees, float strength);
     
     glm::vec3 getWindDirection() const { return windDirection; }
     float getWindStrength() const { return windStrength; }
@@ -32,6 +52,15 @@ public:
     void updateProjectionMatrix(gps::Shader& shader, GLuint location);
     
     bool isShowingDepthMap() const { return showDepthMap; }
+    int getDebugCascade() const { return debugCascade; }
+    int getShadowFilterMode() const { return shadowFilterMode; }
+    // true once per P press
+    bool consumeTimingDumpRequest();
+
+    // shadow filtering modes, matching pcfMode in shaderStart.frag
+    static const int SHADOW_FILTER_HARDWARE = 0;
+    static const int SHADOW_FILTER_GRID = 1;
+    static const int SHADOW_FILTER_POISSON = 2;
     
 private:
     GLFWwindow* window;
@@ -47,6 +76,10 @@ private:
     float lightAngle;
     bool keyUPressed;
     bool keyRPressed;
+    bool keyGPressed;
+    bool keyFPressed;
+    bool keyPPressed;
+    bool timingDumpRequested;
     bool firstMouse;
     float lastX, lastY;
     float yaw, pitch;
@@ -61,23 +94,28 @@ private:
     const float MAX_WIND_ANGLE = 180.0f;
     
     // Sound states
-    ALuint rainBuffer;
-    ALuint spinSoundBuffer;
+    AudioStream* rainStream;
+    SoundId spinSoundBuffer;
+    std::vector<VoiceHandle> spinVoices;
     bool rainSoundPlaying;
     bool spinSoundPlaying;
     
     void printWindInfo();
+    void playSpinSounds();
     
     static Controls* instance;
+    InputRecorder* recorder;
+    bool liveInputEnabled;
+    bool acceptsLiveInput() const;
     
     // Add these members
-    gps::Shader& myCustomShader;
     gps::Shader& lightShader;
-    GLuint& projectionLoc;
     
     glm::vec3& lightDir;  
     
     bool showDepthMap;
+    int debugCascade;
+    int shadowFilterMode;
     
     // Scene presentation
     bool presentationMode;
@@ -90,6 +128,8 @@ private:
     const float PRESENTATION_SPEED = 0.2f; 
     const float RADIUS_DECREASE_SPEED = 10.0f;
     glm::vec3 presentationCenter;
+    const gps::CameraPath* cameraPath;
+    float presentationTime;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "InputRecorder.hpp"
+#include "Controls.hpp"
+#include <fstream>
+#include <iostream>
+
+// the file is a small header followed by fixed 16 byte events, in host byte order:
+// magic, version, timestep, frame count, event count | frame, type, action, code, x, y
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& file, T& value) {
+    return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+InputRecorder::~InputRecorder() {
+    if (mode == Mode::Recording) {
+        stopRecording();
+    }
+}
+
+bool InputRecorder::startRecording(const std::string& fileName, float timestep) {
+    this->fileName = fileName;
+    this->timestep = timestep;
+    events.clear();
+    currentFrame = 0;
+    mode = Mode::Recording;
+    std::cout << "Recording input to " << fileName << std::endl;
+    return true;
+}
+
+bool InputRecorder::stopRecording() {
+    if (mode != Mode::Recording) {
+        return false;
+    }
+    mode = Mode::Idle;
+
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << fileName << " for writing" << std::endl;
+        return false;
+    }
+
+    writeValue(file, FILE_MAGIC);
+    writeValue(file, FILE_VERSION);
+    writeValue(file, timestep);
+    writeValue(file, currentFrame);
+    writeValue(file, (uint32_t)events.size());
+    for (const Event& event : events) {
+        writeValue(file, event.frame);
+        writeValue(file, (uint8_t)event.type);
+        writeValue(file, event.action);
+        writeValue(file, event.code);
+        writeValue(file, event.x);
+        writeValue(file, event.y);
+    }
+
+    std::cout << "Recorded " << events.size() << " input events over "
+              << currentFrame << " frames to " << fileName << std::endl;
+    return true;
+}
+
+bool InputRecorder::startReplay(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open input recording " << fileName << std::endl;
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t eventCount = 0;
+    if (!readValue(file, magic) || magic != FILE_MAGIC ||
+        !readValue(file, version) || version != FILE_VERSION) {
+        std::cerr << fileName << " is not an input recording" << std::endl;
+        return false;
+    }
+    if (!readValue(file, timestep) || !readValue(file, lastFrame) || !readValue(file, eventCount)) {
+        std::cerr << "Input recording " << fileName << " is truncated" << std::endl;
+        return false;
+    }
+
+    events.clear();
+    events.reserve(eventCount);
+    for (uint32_t i = 0; i < eventCount; i++) {
+        Event event;
+        uint8_t type;
+        if (!readValue(file, event.frame) || !readValue(file, type) || !readValue(file, event.action) ||
+            !readValue(file, event.code) || !readValue(file, event.x) || !readValue(file, event.y)) {
+            std::cerr << "Input recording " << fileName << " is truncated" << std::endl;
+            return false;
+        }
+        event.type = (EventType)type;
+        events.push_back(event);
+    }
+
+    this->fileName = fileName;
+    nextEvent = 0;
+    currentFrame = 0;
+    mode = Mode::Replaying;
+    std::cout << "Replaying " << events.size() << " input events over "
+              << lastFrame << " frames from " << fileName << std::endl;
+    return true;
+}
+
+void InputRecorder::record(EventType type, int code, int action, float x, float y) {
+    if (mode != Mode::Recording) {
+        return;
+    }
+    events.push_back({ currentFrame, type, (int16_t)code, (int8_t)action, x, y });
+}
+
+void InputRecorder::recordKey(int key, int action) {
+    record(EventType::Key, key, action, 0.0f, 0.0f);
+}
+
+void InputRecorder::recordCursorPos(double x, double y) {
+    record(EventType::CursorPos, 0, 0, (float)x, (float)y);
+}
+
+void InputRecorder::recordMouseButton(int button, int action) {
+    record(EventType::MouseButton, button, action, 0.0f, 0.0f);
+}
+
+void InputRecorder::recordScroll(double xoffset, double yoffset) {
+    record(EventType::Scroll, 0, 0, (float)xoffset, (float)yoffset);
+}
+
+void InputRecorder::replayFrame(uint32_t frame, Controls& controls) {
+    currentFrame = frame;
+    while (nextEvent < events.size() && events[nextEvent].frame <= frame) {
+        const Event& event = events[nextEvent++];
+        switch (event.type) {
+            case EventType::Key:
+                controls.handleKey(event.code, event.action);
+                break;
+            case EventType::CursorPos:
+                controls.handleCursorPos(event.x, event.y);
+                break;
+            case EventType::MouseButton:
+                controls.handleMouseButton(event.code, event.action);
+                break;
+            case EventType::Scroll:
+                controls.handleScroll(event.x, event.y);
+                break;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef InputRecorder_hpp
+#define InputRecorder_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Controls;
+
+// Records the GLFW input events Controls receives, stamped with the frame they
+// arrived in, and plays them back into Controls at the same frames. Together
+// with a fixed timestep this makes two runs of the same recording identical.
+class InputRecorder {
+public:
+    enum class EventType : uint8_t { Key, CursorPos, MouseButton, Scroll };
+
+    struct Event {
+        uint32_t frame;
+        EventType type;
+        int16_t code;       // key or mouse button
+        int8_t action;      // GLFW_PRESS / GLFW_RELEASE / GLFW_REPEAT
+        float x;            // cursor position or scroll offset
+        float y;
+    };
+
+    enum class Mode { Idle, Recording, Replaying };
+
+    bool startRecording(const std::string& fileName, float timestep);
+    bool startReplay(const std::string& fileName);
+    // writes the recording to disk, called automatically on destruction
+    bool stopRecording();
+    ~InputRecorder();
+
+    void setFrame(uint32_t frame) { currentFrame = frame; }
+    void recordKey(int key, int action);
+    void recordCursorPos(double x, double y);
+    void recordMouseButton(int button, int action);
+    void recordScroll(double xoffset, double yoffset);
+
+    // feeds every event recorded for this frame into controls
+    void replayFrame(uint32_t frame, Controls& controls);
+    bool isReplayFinished() const { return nextEvent >= events.size() && currentFrame >= lastFrame; }
+
+    Mode getMode() const { return mode; }
+    bool isRecording() const { return mode == Mode::Recording; }
+    bool isReplaying() const { return mode == Mode::Replaying; }
+    // timestep stored in the file the recording was made with
+    float getTimestep() const { return timestep; }
+
+private:
+    static constexpr uint32_t FILE_MAGIC = 0x4E494B50; // "PKIN"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    Mode mode = Mode::Idle;
+    std::string fileName;
+    std::vector<Event> events;
+    size_t nextEvent = 0;
+    uint32_t currentFrame = 0;
+    uint32_t lastFrame = 0;
+    float timestep = 0.0f;
+
+    void record(EventType type, int code, int action, float x, float y);
+};
+
+#endif /* InputRecorder_hpp */
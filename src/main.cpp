@@ -1,7 +1,37 @@
 #include "core/Engine.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--record file] [--replay file] [--headless] [--timestep seconds]"
+              << " [--path file] [--benchmark report.csv]" << std::endl;
+}
 
 int main(int argc, const char * argv[]) {
+    EngineOptions options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--timestep") == 0 && hasValue) {
+            options.fixedTimestep = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--path") == 0 && hasValue) {
+            options.cameraPathFile = argv[++i];
+        } else if (strcmp(argv[i], "--benchmark") == 0 && hasValue) {
+            options.benchmarkPath = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
     Engine engine;
+    engine.setOptions(options);
     
     if (!engine.init()) {
         return 1;
@@ -0,0 +1,184 @@
+// Packs short clips into one sound bank (see src/audio/SoundBank.hpp), resampled
+// to the rate the game's audio device runs at so loading is a plain upload.
+//
+//   SoundBankBuilder [--rate hz] output.bank clip.wav...
+
+#include "src/audio/SoundBank.hpp"
+#include <sndfile.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const int DEFAULT_SAMPLE_RATE = 48000;
+// taps on each side of the windowed sinc, plenty for game effects
+static const int SINC_TAPS = 16;
+
+struct ClipData {
+    std::string name;
+    int channels;
+    std::vector<float> samples;     // interleaved
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--rate hz] output.bank clip.wav..." << std::endl;
+}
+
+static std::string clipName(const std::string& path) {
+    size_t nameStart = path.find_last_of("/\\");
+    nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+    size_t extension = path.find_last_of('.');
+    size_t length = extension == std::string::npos || extension < nameStart ? std::string::npos : extension - nameStart;
+    return path.substr(nameStart, length);
+}
+
+static bool readClip(const std::string& path, ClipData& clip, int& sampleRate) {
+    SF_INFO fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    SNDFILE* file = sf_open(path.c_str(), SFM_READ, &fileInfo);
+    if (!file) {
+        std::cerr << "Failed to open sound file: " << path << std::endl;
+        return false;
+    }
+    if (fileInfo.channels != 1 && fileInfo.channels != 2) {
+        std::cerr << path << ": only mono and stereo clips are supported" << std::endl;
+        sf_close(file);
+        return false;
+    }
+
+    clip.name = clipName(path);
+    clip.channels = fileInfo.channels;
+    clip.samples.resize(fileInfo.frames * fileInfo.channels);
+    sf_count_t frames = sf_readf_float(file, clip.samples.data(), fileInfo.frames);
+    clip.samples.resize(frames * fileInfo.channels);
+    sampleRate = fileInfo.samplerate;
+    sf_close(file);
+    return true;
+}
+
+// Blackman windowed sinc, cut off below the lower of the two Nyquist rates so
+// downsampling does not alias
+static std::vector<float> resample(const std::vector<float>& input, int channels, int fromRate, int toRate) {
+    if (fromRate == toRate) {
+        return input;
+    }
+
+    size_t inputFrames = input.size() / channels;
+    size_t outputFrames = (size_t)std::ceil((double)inputFrames * toRate / fromRate);
+    double step = (double)fromRate / toRate;
+    double cutoff = std::min(1.0, (double)toRate / fromRate);
+    int taps = (int)std::ceil(SINC_TAPS / cutoff);
+    std::vector<float> output(outputFrames * channels);
+
+    for (size_t frame = 0; frame < outputFrames; frame++) {
+        double center = frame * step;
+        long first = (long)std::floor(center) - taps + 1;
+        for (int channel = 0; channel < channels; channel++) {
+            double sum = 0.0;
+            double weights = 0.0;
+            for (long i = first; i < first + 2 * taps; i++) {
+                double x = (i - center) * cutoff;
+                double t = (i - center) / taps;
+                if (std::abs(t) >= 1.0) continue;
+                double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+                double window = 0.42 + 0.5 * std::cos(M_PI * t) + 0.08 * std::cos(2.0 * M_PI * t);
+                double weight = sinc * window;
+                weights += weight;
+                if (i >= 0 && i < (long)inputFrames) {
+                    sum += input[i * channels + channel] * weight;
+                }
+            }
+            output[frame * channels + channel] = weights != 0.0 ? (float)(sum / weights) : 0.0f;
+        }
+    }
+    return output;
+}
+
+static size_t align(size_t offset) {
+    return (offset + SoundBank::DATA_ALIGNMENT - 1) / SoundBank::DATA_ALIGNMENT * SoundBank::DATA_ALIGNMENT;
+}
+
+int main(int argc, const char* argv[]) {
+    int sampleRate = DEFAULT_SAMPLE_RATE;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--rate") == 0) {
+        sampleRate = atoi(argv[2]);
+        first = 3;
+    }
+    if (sampleRate <= 0 || argc - first < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    std::string outputPath = argv[first];
+
+    std::vector<ClipData> clips;
+    for (int i = first + 1; i < argc; i++) {
+        ClipData clip;
+        int clipRate;
+        if (!readClip(argv[i], clip, clipRate)) {
+            return 1;
+        }
+        if (clip.name.size() >= SoundBank::NAME_LENGTH) {
+            std::cerr << argv[i] << ": clip name is longer than " << SoundBank::NAME_LENGTH - 1 << " characters" << std::endl;
+            return 1;
+        }
+        for (const ClipData& other : clips) {
+            if (other.name == clip.name) {
+                std::cerr << argv[i] << ": a clip named " << clip.name << " is already in the bank" << std::endl;
+                return 1;
+            }
+        }
+        clip.samples = resample(clip.samples, clip.channels, clipRate, sampleRate);
+        clips.push_back(std::move(clip));
+    }
+
+    SoundBank::Header header = {};
+    header.magic = SoundBank::MAGIC;
+    header.version = SoundBank::VERSION;
+    header.sampleRate = sampleRate;
+    header.clipCount = (uint32_t)clips.size();
+
+    std::vector<SoundBank::Clip> table(clips.size());
+    size_t offset = align(sizeof(header) + table.size() * sizeof(SoundBank::Clip));
+    for (size_t i = 0; i < clips.size(); i++) {
+        memset(&table[i], 0, sizeof(table[i]));
+        strncpy(table[i].name, clips[i].name.c_str(), SoundBank::NAME_LENGTH - 1);
+        table[i].channels = clips[i].channels;
+        table[i].frames = (uint32_t)(clips[i].samples.size() / clips[i].channels);
+        table[i].offset = offset;
+        offset = align(offset + clips[i].samples.size() * sizeof(int16_t));
+    }
+
+    std::ofstream output(outputPath, std::ios::binary);
+    if (!output) {
+        std::cerr << "Failed to create " << outputPath << std::endl;
+        return 1;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SoundBank::Clip));
+
+    size_t written = sizeof(header) + table.size() * sizeof(SoundBank::Clip);
+    for (size_t i = 0; i < clips.size(); i++) {
+        std::vector<char> padding(table[i].offset - written, 0);
+        output.write(padding.data(), padding.size());
+
+        std::vector<int16_t> pcm(clips[i].samples.size());
+        for (size_t s = 0; s < pcm.size(); s++) {
+            float sample = std::max(-1.0f, std::min(1.0f, clips[i].samples[s]));
+            pcm[s] = (int16_t)std::lround(sample * 32767.0f);
+        }
+        output.write(reinterpret_cast<const char*>(pcm.data()), pcm.size() * sizeof(int16_t));
+        written = table[i].offset + pcm.size() * sizeof(int16_t);
+    }
+    if (!output) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << clips.size() << " clips at " << sampleRate << " Hz to " << outputPath << std::endl;
+    return 0;
+}